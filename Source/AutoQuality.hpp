@@ -0,0 +1,101 @@
+// AutoQuality.hpp
+
+#pragma once
+
+/**
+ * Picks an oversampling factor for auto quality from a rough estimate of how
+ * hard the nonlinear stages are being driven: the input's peak envelope times
+ * the gain the preamp, TS and power amp apply ahead of their waveshapers.
+ * Quality steps up as soon as the drive crosses a threshold and only steps
+ * back down once it has stayed well below it for the hold time, so it
+ * doesn't flap on the decay of a note.
+ */
+class DriveEstimator
+{
+public:
+    /* 1x, 2x and 4x */
+    static constexpr int numLevels = 3;
+
+    void prepare(double newSampleRate)
+    {
+        sampleRate = newSampleRate;
+        reset();
+    }
+
+    void reset()
+    {
+        envelope = 0.0;
+        level = numLevels - 1;
+        holdSamples = 0;
+    }
+
+    /**
+     * Update from a block of input to the amp and return the level it needs,
+     * 0 to numLevels - 1, given the current parameter values.
+     */
+    int process(const dsp::AudioBlock<double> &block, float gain, float master, float tsX, bool hiGain)
+    {
+        double peak = 0.0;
+        for (size_t ch = 0; ch < block.getNumChannels(); ++ch)
+        {
+            const auto range = FloatVectorOperations::findMinAndMax(block.getChannelPointer(ch), (int)block.getNumSamples());
+            peak = jmax(peak, std::abs(range.getStart()), std::abs(range.getEnd()));
+        }
+
+        const auto numSamples = (double)block.getNumSamples();
+        envelope = jmax(peak, envelope * std::exp(-numSamples / (releaseTime * sampleRate)));
+
+        const auto driveDB = getDriveDB(envelope, gain, master, tsX, hiGain);
+
+        int wanted = 0;
+        while (wanted < numLevels - 1 && driveDB > thresholdsDB[wanted])
+            ++wanted;
+
+        if (wanted >= level)
+        {
+            level = wanted;
+            holdSamples = 0;
+        }
+        /* only count down while clear of the hysteresis band */
+        else if (driveDB < thresholdsDB[level - 1] - hysteresisDB)
+        {
+            holdSamples += (int)numSamples;
+            if (holdSamples > (int)(holdTime * sampleRate))
+            {
+                --level;
+                holdSamples = 0;
+            }
+        }
+        else
+            holdSamples = 0;
+
+        return level;
+    }
+
+    int getLevel() const { return level; }
+
+private:
+    /**
+     * Peak level at the hardest driven waveshaper, in dB. Mirrors the gain
+     * staging of AmpProcessor: preamp gain * 8 (Hi) or * 4 (Lo), the TS adding
+     * up to its drive ahead of it, and the power amp seeing master * 0.6 times
+     * the preamp output, which its saturation holds to about unity.
+     */
+    static double getDriveDB(double level, float gain, float master, float tsX, bool hiGain)
+    {
+        const auto preDrive = level * gain * (hiGain ? 8.0 : 4.0) * (1.0 + tsX);
+        const auto powerDrive = jmin(preDrive, 1.0) * master * 0.6;
+
+        return Decibels::gainToDecibels(jmax(preDrive, powerDrive), -100.0);
+    }
+
+    /* drive above which 2x, then 4x, is needed */
+    static constexpr double thresholdsDB[numLevels - 1] = {0.0, 12.0};
+    static constexpr double hysteresisDB = 3.0;
+    static constexpr double releaseTime = 0.3, holdTime = 0.5;
+
+    double sampleRate = 44100.0;
+    double envelope = 0.0;
+    int level = numLevels - 1;
+    int holdSamples = 0;
+};
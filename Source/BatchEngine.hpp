@@ -0,0 +1,231 @@
+// BatchEngine.hpp
+
+#pragma once
+
+#include "PluginProcessor.h"
+#include "WorkStealingPool.hpp"
+
+/**
+ * Runs many independent STR-X chains in one process, without a plugin host,
+ * for offline and server use. Each stream has its own processor (parameters,
+ * state and cabinet) and its own buffer, and builds only the quality it runs,
+ * with no background builder (STRXAudioProcessor::setBuildOnDemand). Streams
+ * are spread over a work-stealing pool, each with the same home worker from
+ * block to block. A stream's block is only stolen while its home worker has
+ * others still waiting, so with an even load its state stays in that core's
+ * cache.
+ *
+ * Add streams and prepare from one thread, then for each block: fill every
+ * stream's buffer with input, call process() and read the output back from
+ * the same buffers.
+ *
+ * With lane packing on, mono streams whose amps share every setting are
+ * grouped vec::size at a time and run as the lanes of one SIMD pass (see
+ * STRXAudioProcessor::processPacked). Groups are formed on the first block
+ * after streams are added, prepared or packing is switched. If a member's
+ * settings drift from its group's, the group splits and its streams run on
+ * their own from then on. A stream's amp and oversampler state moves into
+ * its lane when it's packed and back out when its group splits or is
+ * re-formed, so packing doesn't change its output.
+ */
+class BatchEngine
+{
+public:
+    /* 0 threads for one per physical core */
+    explicit BatchEngine(int numThreads = 0) : pool(numThreads) {}
+
+    void setLanePacking(bool shouldPack)
+    {
+        lanePacking = shouldPack;
+        groupsDirty = true;
+    }
+
+    /* streams sharing a pass, one entry per pass; single streams run on their own */
+    const std::vector<std::vector<int>> &getGroups()
+    {
+        if (groupsDirty)
+            regroup();
+        return groups;
+    }
+
+    int getNumStreams() const { return (int)streams.size(); }
+    int getNumThreads() const { return pool.getNumWorkers(); }
+
+    /* a new stream with default parameters; returns its index */
+    int addStream()
+    {
+        auto s = std::make_unique<Stream>();
+        s->home = (int)streams.size() % pool.getNumWorkers();
+        s->processor.setNonRealtime(true);
+        s->processor.setBuildOnDemand(true);
+
+        if (prepared)
+            prepareStream(*s);
+
+        streams.push_back(std::move(s));
+        groupsDirty = true;
+        return (int)streams.size() - 1;
+    }
+
+    /* the stream's processor, for its parameters (apvts) and state; not while process() runs */
+    STRXAudioProcessor &getProcessor(int stream) { return streams[(size_t)stream]->processor; }
+
+    /* sets a parameter from its real value, as the processor would from its host */
+    void setParameter(int stream, const String &paramID, float value)
+    {
+        if (auto *param = getProcessor(stream).apvts.getParameter(paramID))
+            param->setValueNotifyingHost(param->convertTo0to1(value));
+    }
+
+    void prepare(double newSampleRate, int newMaxBlockSize, int newNumChannels = 2)
+    {
+        sampleRate = newSampleRate;
+        maxBlockSize = newMaxBlockSize;
+        numChannels = newNumChannels;
+        prepared = true;
+
+        for (auto &s : streams)
+            pool.submit(s->home, [this, &s = *s] { prepareStream(s); });
+        pool.wait();
+
+        /* every stream starts clean, so there's no packed state to hand back */
+        groups.clear();
+        groupsDirty = true;
+    }
+
+    /* input before process(), output after; numChannels x maxBlockSize */
+    AudioBuffer<double> &getBuffer(int stream) { return streams[(size_t)stream]->buffer; }
+
+    /* process numSamples (up to the max block size) of every stream in place, returning when all are done */
+    void process(int numSamples)
+    {
+        jassert(prepared && numSamples <= maxBlockSize);
+
+        if (groupsDirty)
+            regroup();
+        else
+            splitUnpackableGroups();
+
+        for (auto &group : groups)
+        {
+            auto &leader = *streams[(size_t)group[0]];
+
+            if (group.size() > 1)
+            {
+                pool.submit(leader.home, [this, &group, numSamples]
+                {
+                    std::vector<AudioBuffer<double> *> buffers;
+                    for (auto i : group)
+                        buffers.push_back(&streams[(size_t)i]->buffer);
+                    STRXAudioProcessor::processPacked(getProcessors(group), buffers, numSamples);
+                });
+            }
+            else
+                pool.submit(leader.home, [&leader, numSamples] { processStream(leader, numSamples); });
+        }
+
+        pool.wait();
+    }
+
+private:
+    struct Stream
+    {
+        STRXAudioProcessor processor;
+        AudioBuffer<double> buffer;
+        int home = 0;
+    };
+
+    static void processStream(Stream &s, int numSamples)
+    {
+        AudioBuffer<double> block(s.buffer.getArrayOfWritePointers(), s.buffer.getNumChannels(), numSamples);
+        MidiBuffer midi;
+        s.processor.processBlock(block, midi);
+    }
+
+    std::vector<STRXAudioProcessor *> getProcessors(const std::vector<int> &group)
+    {
+        std::vector<STRXAudioProcessor *> processors;
+        for (auto i : group)
+            processors.push_back(&streams[(size_t)i]->processor);
+        return processors;
+    }
+
+    bool isStillPackable(const std::vector<int> &group) const
+    {
+        const auto &leader = streams[(size_t)group[0]]->processor;
+        for (size_t i = 1; i < group.size(); ++i)
+            if (!leader.canPackWith(streams[(size_t)group[i]]->processor))
+                return false;
+        return true;
+    }
+
+    /* a group that no longer packs becomes one group per stream, without regrouping the rest */
+    void splitUnpackableGroups()
+    {
+        for (size_t g = 0; g < groups.size(); ++g)
+        {
+            if (groups[g].size() < 2 || isStillPackable(groups[g]))
+                continue;
+
+            STRXAudioProcessor::scatterLanes(getProcessors(groups[g]));
+
+            const auto members = groups[g];
+            groups[g] = {members[0]};
+            for (size_t i = 1; i < members.size(); ++i)
+                groups.push_back({members[i]});
+        }
+    }
+
+    /* greedy: each stream not yet placed leads a group and takes the next ones that pack with it */
+    void regroup()
+    {
+        for (auto &group : groups)
+            if (group.size() > 1)
+                STRXAudioProcessor::scatterLanes(getProcessors(group));
+
+        groups.clear();
+        std::vector<bool> placed(streams.size(), false);
+
+        for (size_t i = 0; i < streams.size(); ++i)
+        {
+            if (placed[i])
+                continue;
+
+            std::vector<int> group{(int)i};
+            placed[i] = true;
+
+            for (size_t j = i + 1; lanePacking && j < streams.size() && group.size() < vec::size; ++j)
+                if (!placed[j] && streams[i]->processor.canPackWith(streams[j]->processor))
+                {
+                    group.push_back((int)j);
+                    placed[j] = true;
+                }
+
+            if (group.size() > 1)
+                STRXAudioProcessor::gatherLanes(getProcessors(group));
+
+            groups.push_back(std::move(group));
+        }
+
+        groupsDirty = false;
+    }
+
+    void prepareStream(Stream &s)
+    {
+        s.processor.setPlayConfigDetails(numChannels, numChannels, sampleRate, maxBlockSize);
+        s.processor.prepareToPlay(sampleRate, maxBlockSize);
+        s.buffer.setSize(numChannels, maxBlockSize);
+    }
+
+    WorkStealingPool pool;
+    std::vector<std::unique_ptr<Stream>> streams;
+
+    double sampleRate = 44100.0;
+    int maxBlockSize = 512, numChannels = 2;
+    bool prepared = false;
+
+    bool lanePacking = false, groupsDirty = true;
+    std::vector<std::vector<int>> groups;
+
+    JUCE_DECLARE_NON_COPYABLE(BatchEngine)
+};
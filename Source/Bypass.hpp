@@ -0,0 +1,150 @@
+// Bypass.hpp
+
+#pragma once
+
+/**
+ * Soft bypass which keeps a dry path delayed by the processing latency and
+ * crossfades between it and the processed signal. While fully bypassed the
+ * processor only runs the dry delay, so no DSP work is done.
+ */
+class SoftBypass
+{
+public:
+    SoftBypass() = default;
+
+    void prepare(const dsp::ProcessSpec &spec)
+    {
+        dryBuffer.setSize(spec.numChannels, spec.maximumBlockSize);
+        history.setSize(spec.numChannels, spec.maximumBlockSize);
+        historySize = 0;
+
+        delay.prepare(spec);
+        delay.setDelay(latency);
+
+        mix.reset(spec.sampleRate, fadeTime);
+        mix.setCurrentAndTargetValue(bypassed ? 0.0 : 1.0);
+
+        ramp.resize(spec.maximumBlockSize);
+    }
+
+    void reset()
+    {
+        delay.reset();
+        mix.setCurrentAndTargetValue(mix.getTargetValue());
+        history.clear();
+        historySize = 0;
+    }
+
+    /* keep the dry path aligned with the latency reported to the host */
+    void setLatency(int newLatency)
+    {
+        if (newLatency == latency)
+            return;
+
+        latency = jlimit(0, maxLatency, newLatency);
+        delay.setDelay(latency);
+    }
+
+    void setBypassed(bool shouldBeBypassed)
+    {
+        if (shouldBeBypassed == bypassed)
+            return;
+
+        bypassed = shouldBeBypassed;
+        mix.setTargetValue(bypassed ? 0.0 : 1.0);
+    }
+
+    /* true once the fade out has finished and the processing can be skipped entirely */
+    bool isFullyBypassed() const
+    {
+        return bypassed && !mix.isSmoothing();
+    }
+
+    /* true while processing with no fade in or out under way */
+    bool isFullyActive() const
+    {
+        return !bypassed && !mix.isSmoothing();
+    }
+
+    /* true on the first processed block after being fully bypassed */
+    bool isResuming() const { return wasFullyBypassed; }
+
+    /* input of the last bypassed block, used to warm up filter state on re-entry */
+    dsp::AudioBlock<double> getHistory()
+    {
+        return dsp::AudioBlock<double>(history).getSubBlock(0, (size_t)historySize);
+    }
+
+    /* output the delayed dry signal in place */
+    void processBypassed(dsp::AudioBlock<double> &block)
+    {
+        storeHistory(block);
+        pushDry(block);
+
+        for (size_t ch = 0; ch < block.getNumChannels(); ++ch)
+            FloatVectorOperations::copy(block.getChannelPointer(ch), dryBuffer.getReadPointer((int)ch), (int)block.getNumSamples());
+
+        wasFullyBypassed = true;
+    }
+
+    /* call with the unprocessed input before running the DSP */
+    void pushDry(const dsp::AudioBlock<double> &block)
+    {
+        const auto numChannels = jmin(block.getNumChannels(), (size_t)dryBuffer.getNumChannels());
+        for (size_t ch = 0; ch < numChannels; ++ch)
+        {
+            auto *in = block.getChannelPointer(ch);
+            auto *dry = dryBuffer.getWritePointer((int)ch);
+            for (size_t i = 0; i < block.getNumSamples(); ++i)
+            {
+                delay.pushSample((int)ch, in[i]);
+                dry[i] = delay.popSample((int)ch);
+            }
+        }
+
+        wasFullyBypassed = false;
+    }
+
+    /* crossfade the processed block with the delayed dry signal */
+    void processMix(dsp::AudioBlock<double> &block)
+    {
+        if (!mix.isSmoothing())
+            return;
+
+        const auto numSamples = block.getNumSamples();
+        for (size_t i = 0; i < numSamples; ++i)
+            ramp[i] = mix.getNextValue();
+
+        const auto numChannels = jmin(block.getNumChannels(), (size_t)dryBuffer.getNumChannels());
+        for (size_t ch = 0; ch < numChannels; ++ch)
+        {
+            auto *out = block.getChannelPointer(ch);
+            auto *dry = dryBuffer.getReadPointer((int)ch);
+            for (size_t i = 0; i < numSamples; ++i)
+                out[i] = dry[i] + ramp[i] * (out[i] - dry[i]);
+        }
+    }
+
+private:
+    void storeHistory(const dsp::AudioBlock<double> &block)
+    {
+        historySize = (int)jmin(block.getNumSamples(), (size_t)history.getNumSamples());
+        const auto numChannels = jmin(block.getNumChannels(), (size_t)history.getNumChannels());
+        for (size_t ch = 0; ch < numChannels; ++ch)
+            FloatVectorOperations::copy(history.getWritePointer((int)ch), block.getChannelPointer(ch), historySize);
+    }
+
+    static constexpr double fadeTime = 0.005;
+    static constexpr int maxLatency = 1024;
+
+    dsp::DelayLine<double, dsp::DelayLineInterpolationTypes::None> delay{maxLatency};
+    AudioBuffer<double> dryBuffer, history;
+    int historySize = 0;
+
+    SmoothedValue<double> mix;
+    std::vector<double> ramp;
+
+    int latency = 0;
+    bool bypassed = false;
+    bool wasFullyBypassed = false;
+};
@@ -0,0 +1,46 @@
+// CPUMeter.hpp
+
+#pragma once
+
+/* one line readout of each stage's share of the real-time budget, polled from the processor's profiler */
+struct CPUMeter : Component, private Timer
+{
+    CPUMeter(StageProfiler &p) : profiler(p)
+    {
+        setInterceptsMouseClicks(false, false);
+        startTimerHz(4);
+    }
+
+    ~CPUMeter() override { stopTimer(); }
+
+    void paint(Graphics &g) override
+    {
+        g.setColour(Colour(LIGHT_ACCENT).withAlpha(0.6f));
+        g.setFont((float)getHeight());
+        g.drawFittedText(text, getLocalBounds(), Justification::centredLeft, 1);
+    }
+
+private:
+    void timerCallback() override
+    {
+        const auto loads = profiler.getLoads();
+
+        String newText;
+        double total = 0.0;
+        for (int s = 0; s < StageProfiler::numStages; ++s)
+        {
+            newText << StageProfiler::getStageName(s) << " " << String(loads[(size_t)s] * 100.0, 1) << "%  ";
+            total += loads[(size_t)s];
+        }
+        newText << "Total " << String(total * 100.0, 1) << "%";
+
+        if (newText != text)
+        {
+            text = newText;
+            repaint();
+        }
+    }
+
+    StageProfiler &profiler;
+    String text;
+};
@@ -0,0 +1,491 @@
+// Cabinet.hpp
+
+#pragma once
+
+/**
+ * Speaker cabinet convolution, run at the host rate after downsampling.
+ *
+ * The impulse response is split non-uniformly: a short head in small
+ * partitions, which recomputes the FFT of the current partial block on every
+ * call so it adds no latency at any host block size, and a long tail in
+ * partitions as long as the whole head. The tail is only transformed once per
+ * partition, and its one-partition delay is exactly covered by the head.
+ */
+
+using fvec = xsimd::batch<float>;
+using FloatVector = std::vector<float, xsimd::aligned_allocator<float>>;
+
+/* impulse response segment as uniform partition spectra, stored as separate real and imaginary planes */
+struct ConvolutionPartitions
+{
+    /* transform an impulse response segment */
+    ConvolutionPartitions(const float *ir, size_t irSize, size_t partitionSize)
+        : ConvolutionPartitions(partitionSize, getNumPartitions(irSize, partitionSize))
+    {
+        storage.resize(2 * getPlaneSize());
+        re = storage.data();
+        im = storage.data() + getPlaneSize();
+
+        std::vector<float> buffer(fftSize * 2);
+
+        for (size_t p = 0; p < numPartitions; ++p)
+        {
+            std::fill(buffer.begin(), buffer.end(), 0.f);
+            const auto start = p * blockSize;
+            if (start < irSize)
+                std::copy(ir + start, ir + jmin(irSize, start + blockSize), buffer.begin());
+
+            fft.performRealOnlyForwardTransform(buffer.data(), true);
+            split(buffer.data(), storage.data() + p * numBins, storage.data() + getPlaneSize() + p * numBins, blockSize + 1);
+        }
+    }
+
+    /* spectra computed earlier, e.g. mapped from the IR cache. The planes must be aligned and outlive this */
+    ConvolutionPartitions(const float *real, const float *imag, size_t partitionSize, size_t partitionCount)
+        : ConvolutionPartitions(partitionSize, partitionCount)
+    {
+        re = real;
+        im = imag;
+    }
+
+    const float *getReal(size_t partition) const { return re + partition * numBins; }
+    const float *getImag(size_t partition) const { return im + partition * numBins; }
+
+    /* floats per real or imaginary plane */
+    size_t getPlaneSize() const { return numPartitions * numBins; }
+
+    static size_t getNumPartitions(size_t irSize, size_t partitionSize)
+    {
+        return jmax((size_t)1, (irSize + partitionSize - 1) / partitionSize);
+    }
+
+    /**
+     * Bins per partition, padded to a whole 64-byte line rather than just the
+     * native vector width, so the layout is the same on every target and
+     * partitions stay aligned when mapped from disk.
+     */
+    static size_t getNumBins(size_t partitionSize)
+    {
+        return (partitionSize + 1 + binAlignment - 1) / binAlignment * binAlignment;
+    }
+
+    /* interleaved JUCE FFT output -> split planes */
+    static void split(const float *interleaved, float *real, float *imag, size_t numComplex)
+    {
+        for (size_t i = 0; i < numComplex; ++i)
+        {
+            real[i] = interleaved[2 * i];
+            imag[i] = interleaved[2 * i + 1];
+        }
+    }
+
+    /* split planes -> interleaved JUCE FFT input */
+    static void merge(const float *real, const float *imag, float *interleaved, size_t numComplex)
+    {
+        for (size_t i = 0; i < numComplex; ++i)
+        {
+            interleaved[2 * i] = real[i];
+            interleaved[2 * i + 1] = imag[i];
+        }
+    }
+
+    /* acc += a * b, complex, over whole vectors */
+    static void multiplyAccumulate(float *accRe, float *accIm, const float *aRe, const float *aIm,
+                                   const float *bRe, const float *bIm, size_t numBins)
+    {
+        for (size_t i = 0; i < numBins; i += fvec::size)
+        {
+            const auto ar = xsimd::load_aligned(aRe + i);
+            const auto ai = xsimd::load_aligned(aIm + i);
+            const auto br = xsimd::load_aligned(bRe + i);
+            const auto bi = xsimd::load_aligned(bIm + i);
+
+            auto cr = xsimd::load_aligned(accRe + i);
+            auto ci = xsimd::load_aligned(accIm + i);
+            cr += ar * br - ai * bi;
+            ci += ar * bi + ai * br;
+
+            xsimd::store_aligned(accRe + i, cr);
+            xsimd::store_aligned(accIm + i, ci);
+        }
+    }
+
+    static constexpr size_t binAlignment = 16;
+
+    const size_t blockSize, fftSize, numBins, numPartitions;
+    const dsp::FFT fft;
+
+private:
+    ConvolutionPartitions(size_t partitionSize, size_t partitionCount)
+        : blockSize(partitionSize),
+          fftSize(partitionSize * 2),
+          numBins(getNumBins(partitionSize)),
+          numPartitions(partitionCount),
+          fft(getOrder(partitionSize * 2))
+    {
+    }
+
+    static int getOrder(size_t size)
+    {
+        int order = 0;
+        while (((size_t)1 << order) < size)
+            ++order;
+        return order;
+    }
+
+    FloatVector storage;
+    const float *re = nullptr, *im = nullptr;
+};
+
+/* uniformly partitioned overlap-add convolution of one channel, using a frequency-domain delay line */
+class UniformConvolver
+{
+public:
+    explicit UniformConvolver(const ConvolutionPartitions &partitions)
+        : ir(partitions),
+          input(ir.blockSize), overlap(ir.blockSize), output(ir.blockSize),
+          fftBuffer(ir.fftSize * 2),
+          historyRe(ir.numPartitions * ir.numBins), historyIm(ir.numPartitions * ir.numBins),
+          currentRe(ir.numBins), currentIm(ir.numBins),
+          accRe(ir.numBins), accIm(ir.numBins),
+          tailRe(ir.numBins), tailIm(ir.numBins)
+    {
+    }
+
+    void reset()
+    {
+        for (auto *v : {&input, &overlap, &output, &fftBuffer, &historyRe, &historyIm,
+                        &currentRe, &currentIm, &accRe, &accIm, &tailRe, &tailIm})
+            std::fill(v->begin(), v->end(), 0.f);
+
+        inputPos = 0;
+        newest = 0;
+    }
+
+    /**
+     * Output has no latency. Each call transforms the partly filled input block
+     * and multiplies it with the first partition; the older partitions' sum is
+     * only computed when a block completes.
+     */
+    void processZeroLatency(const float *in, float *out, size_t numSamples)
+    {
+        const auto B = ir.blockSize;
+
+        for (size_t done = 0; done < numSamples;)
+        {
+            const auto n = jmin(numSamples - done, B - inputPos);
+            std::copy(in + done, in + done + n, input.begin() + (long)inputPos);
+
+            transformInput();
+
+            std::copy(tailRe.begin(), tailRe.end(), accRe.begin());
+            std::copy(tailIm.begin(), tailIm.end(), accIm.begin());
+            ConvolutionPartitions::multiplyAccumulate(accRe.data(), accIm.data(), currentRe.data(), currentIm.data(),
+                                                      ir.getReal(0), ir.getImag(0), ir.numBins);
+            inverseTransform();
+
+            for (size_t i = 0; i < n; ++i)
+                out[done + i] = fftBuffer[inputPos + i] + overlap[inputPos + i];
+
+            inputPos += n;
+            done += n;
+
+            if (inputPos == B)
+            {
+                std::copy(fftBuffer.begin() + (long)B, fftBuffer.begin() + (long)(2 * B), overlap.begin());
+                pushHistory();
+                sumPartitions(1, tailRe, tailIm);
+                std::fill(input.begin(), input.end(), 0.f);
+                inputPos = 0;
+            }
+        }
+    }
+
+    /* output is delayed by exactly one block, with all the work done once per block */
+    void processDelayed(const float *in, float *out, size_t numSamples)
+    {
+        const auto B = ir.blockSize;
+
+        for (size_t done = 0; done < numSamples;)
+        {
+            const auto n = jmin(numSamples - done, B - inputPos);
+            std::copy(in + done, in + done + n, input.begin() + (long)inputPos);
+            std::copy(output.begin() + (long)inputPos, output.begin() + (long)(inputPos + n), out + done);
+
+            inputPos += n;
+            done += n;
+
+            if (inputPos == B)
+            {
+                transformInput();
+                pushHistory();
+                sumPartitions(0, accRe, accIm);
+                inverseTransform();
+
+                for (size_t i = 0; i < B; ++i)
+                    output[i] = fftBuffer[i] + overlap[i];
+                std::copy(fftBuffer.begin() + (long)B, fftBuffer.begin() + (long)(2 * B), overlap.begin());
+
+                std::fill(input.begin(), input.end(), 0.f);
+                inputPos = 0;
+            }
+        }
+    }
+
+private:
+    void transformInput()
+    {
+        std::fill(fftBuffer.begin(), fftBuffer.end(), 0.f);
+        std::copy(input.begin(), input.end(), fftBuffer.begin());
+        ir.fft.performRealOnlyForwardTransform(fftBuffer.data(), true);
+        ConvolutionPartitions::split(fftBuffer.data(), currentRe.data(), currentIm.data(), ir.blockSize + 1);
+    }
+
+    void inverseTransform()
+    {
+        ConvolutionPartitions::merge(accRe.data(), accIm.data(), fftBuffer.data(), ir.blockSize + 1);
+        ir.fft.performRealOnlyInverseTransform(fftBuffer.data());
+    }
+
+    /* store the completed block's spectrum as the newest entry of the delay line */
+    void pushHistory()
+    {
+        newest = (newest + 1) % ir.numPartitions;
+        std::copy(currentRe.begin(), currentRe.end(), historyRe.begin() + (long)(newest * ir.numBins));
+        std::copy(currentIm.begin(), currentIm.end(), historyIm.begin() + (long)(newest * ir.numBins));
+    }
+
+    /**
+     * Sum partition p times the spectrum of the block p - first blocks older
+     * than the newest, for p in [first, numPartitions).
+     */
+    void sumPartitions(size_t first, FloatVector &sumRe, FloatVector &sumIm)
+    {
+        std::fill(sumRe.begin(), sumRe.end(), 0.f);
+        std::fill(sumIm.begin(), sumIm.end(), 0.f);
+
+        const auto P = ir.numPartitions;
+        for (size_t p = first; p < P; ++p)
+        {
+            const auto slot = (newest + P - (p - first)) % P;
+            ConvolutionPartitions::multiplyAccumulate(sumRe.data(), sumIm.data(),
+                                                      historyRe.data() + slot * ir.numBins, historyIm.data() + slot * ir.numBins,
+                                                      ir.getReal(p), ir.getImag(p), ir.numBins);
+        }
+    }
+
+    const ConvolutionPartitions &ir;
+
+    FloatVector input, overlap, output, fftBuffer;
+    FloatVector historyRe, historyIm, currentRe, currentIm, accRe, accIm, tailRe, tailIm;
+
+    size_t inputPos = 0, newest = 0;
+};
+
+/**
+ * An impulse response at the processing rate, transformed into head and tail
+ * partitions for every channel. Immutable once built, so it can be shared
+ * read-only between all instances using the same IR (see IRLibrary).
+ */
+struct CabinetResponse
+{
+    /* transform an impulse response already at the processing rate */
+    CabinetResponse(const AudioBuffer<float> &ir, size_t headBlock, uint64 contentHash)
+        : hash(contentHash), headBlockSize(headBlock), irSize((size_t)ir.getNumSamples())
+    {
+        const auto headSize = getHeadSize();
+
+        for (int ch = 0; ch < ir.getNumChannels(); ++ch)
+        {
+            auto *data = ir.getReadPointer(ch);
+            heads.push_back(std::make_unique<ConvolutionPartitions>(data, jmin(irSize, headSize), headBlockSize));
+            if (irSize > headSize)
+                tails.push_back(std::make_unique<ConvolutionPartitions>(data + headSize, irSize - headSize, headSize));
+        }
+    }
+
+    /* use planes laid out by the IR cache: for each channel head real, head imag, tail real, tail imag */
+    CabinetResponse(std::unique_ptr<MemoryMappedFile> mappedFile, const float *planes, size_t numChannels,
+                    size_t length, size_t headBlock, uint64 contentHash)
+        : hash(contentHash), headBlockSize(headBlock), irSize(length), mapping(std::move(mappedFile))
+    {
+        const auto headSize = getHeadSize();
+        const auto numHead = ConvolutionPartitions::getNumPartitions(jmin(irSize, headSize), headBlockSize);
+        const auto numTail = ConvolutionPartitions::getNumPartitions(irSize - jmin(irSize, headSize), headSize);
+        const auto headPlane = numHead * ConvolutionPartitions::getNumBins(headBlockSize);
+        const auto tailPlane = numTail * ConvolutionPartitions::getNumBins(headSize);
+
+        for (size_t ch = 0; ch < numChannels; ++ch)
+        {
+            heads.push_back(std::make_unique<ConvolutionPartitions>(planes, planes + headPlane, headBlockSize, numHead));
+            planes += 2 * headPlane;
+
+            if (irSize > headSize)
+            {
+                tails.push_back(std::make_unique<ConvolutionPartitions>(planes, planes + tailPlane, headSize, numTail));
+                planes += 2 * tailPlane;
+            }
+        }
+    }
+
+    /* total floats held by the partitions of all channels, as laid out by the cache */
+    static size_t getDataSize(size_t numChannels, size_t length, size_t headBlock)
+    {
+        const auto headSize = headBlock * headPartitions;
+        const auto numHead = ConvolutionPartitions::getNumPartitions(jmin(length, headSize), headBlock);
+        auto size = 2 * numHead * ConvolutionPartitions::getNumBins(headBlock);
+        if (length > headSize)
+            size += 2 * ConvolutionPartitions::getNumPartitions(length - headSize, headSize) * ConvolutionPartitions::getNumBins(headSize);
+
+        return numChannels * size;
+    }
+
+    /* the head partitions are as long as the host block, so a full block only needs one transform */
+    static size_t getHeadBlockSize(int maximumBlockSize)
+    {
+        return (size_t)jlimit(minHeadBlock, maxHeadBlock, nextPowerOfTwo(maximumBlockSize));
+    }
+
+    size_t getHeadSize() const { return headBlockSize * headPartitions; }
+    size_t getNumChannels() const { return heads.size(); }
+
+    static constexpr int minHeadBlock = 32, maxHeadBlock = 512;
+    static constexpr size_t headPartitions = 8;
+
+    const uint64 hash;
+    const size_t headBlockSize, irSize;
+    std::vector<std::unique_ptr<ConvolutionPartitions>> heads, tails;
+
+private:
+    std::unique_ptr<MemoryMappedFile> mapping;
+};
+
+/* per-channel convolution state for one shared response */
+class CabinetEngine
+{
+public:
+    CabinetEngine(std::shared_ptr<const CabinetResponse> responseToUse, const dsp::ProcessSpec &spec)
+        : response(std::move(responseToUse))
+    {
+        for (size_t ch = 0; ch < spec.numChannels; ++ch)
+        {
+            const auto irChannel = jmin(ch, response->getNumChannels() - 1);
+            headConvolvers.push_back(std::make_unique<UniformConvolver>(*response->heads[irChannel]));
+            if (!response->tails.empty())
+                tailConvolvers.push_back(std::make_unique<UniformConvolver>(*response->tails[irChannel]));
+        }
+
+        in.resize(spec.maximumBlockSize);
+        out.resize(spec.maximumBlockSize);
+        tail.resize(spec.maximumBlockSize);
+    }
+
+    void reset()
+    {
+        for (auto &c : headConvolvers)
+            c->reset();
+        for (auto &c : tailConvolvers)
+            c->reset();
+    }
+
+    void process(dsp::AudioBlock<double> &block)
+    {
+        const auto numChannels = jmin(block.getNumChannels(), headConvolvers.size());
+
+        for (size_t start = 0; start < block.getNumSamples(); start += in.size())
+        {
+            const auto n = jmin(in.size(), block.getNumSamples() - start);
+
+            for (size_t ch = 0; ch < numChannels; ++ch)
+            {
+                auto *x = block.getChannelPointer(ch) + start;
+                for (size_t i = 0; i < n; ++i)
+                    in[i] = (float)x[i];
+
+                headConvolvers[ch]->processZeroLatency(in.data(), out.data(), n);
+                if (!tailConvolvers.empty())
+                {
+                    tailConvolvers[ch]->processDelayed(in.data(), tail.data(), n);
+                    FloatVectorOperations::add(out.data(), tail.data(), (int)n);
+                }
+
+                for (size_t i = 0; i < n; ++i)
+                    x[i] = (double)out[i];
+            }
+        }
+    }
+
+private:
+    std::shared_ptr<const CabinetResponse> response;
+
+    std::vector<std::unique_ptr<UniformConvolver>> headConvolvers, tailConvolvers;
+    FloatVector in, out, tail;
+};
+
+/**
+ * Runs the current response and swaps new ones in without blocking or
+ * deallocating on the audio thread.
+ */
+class Cabinet
+{
+public:
+    Cabinet() = default;
+
+    void prepare(const dsp::ProcessSpec &newSpec, std::shared_ptr<const CabinetResponse> response)
+    {
+        spec = newSpec;
+
+        auto newEngine = std::make_unique<CabinetEngine>(std::move(response), spec);
+
+        const SpinLock::ScopedLockType sl(swapLock);
+        engine = std::move(newEngine);
+        incoming.reset();
+        retired.reset();
+        hasIncoming = false;
+    }
+
+    void reset()
+    {
+        if (engine)
+            engine->reset();
+    }
+
+    /* message thread, once prepared */
+    void setResponse(std::shared_ptr<const CabinetResponse> response)
+    {
+        auto newEngine = std::make_unique<CabinetEngine>(std::move(response), spec);
+        std::unique_ptr<CabinetEngine> oldRetired, oldIncoming;
+
+        {
+            const SpinLock::ScopedLockType sl(swapLock);
+            oldRetired = std::move(retired);
+            oldIncoming = std::move(incoming);
+            incoming = std::move(newEngine);
+            hasIncoming = true;
+        }
+    }
+
+    void process(dsp::AudioBlock<double> &block)
+    {
+        if (hasIncoming)
+        {
+            const SpinLock::ScopedTryLockType tl(swapLock);
+            if (tl.isLocked())
+            {
+                retired = std::move(engine);
+                engine = std::move(incoming);
+                hasIncoming = false;
+            }
+        }
+
+        if (engine)
+            engine->process(block);
+    }
+
+private:
+    dsp::ProcessSpec spec{0.0, 0, 0};
+
+    SpinLock swapLock;
+    std::unique_ptr<CabinetEngine> engine, incoming, retired;
+    std::atomic<bool> hasIncoming = false;
+};
@@ -0,0 +1,158 @@
+// Deadline.hpp
+
+#pragma once
+
+/**
+ * Per-instance record of how close each callback comes to its real-time
+ * budget (block size / sample rate). The audio thread files every callback
+ * into a histogram of load and pushes the slow ones, tagged with what the
+ * callback did, into a lock-free ring; a single reader takes snapshots. Max,
+ * p99 and overruns come from the histogram, so reading never stalls the
+ * audio thread.
+ */
+class DeadlineMonitor
+{
+public:
+    /* what a callback did besides the usual, to relate spikes to code paths */
+    enum Tag : uint32
+    {
+        messages = 1,
+        qualityChange = 1 << 1,
+        smoothing = 1 << 2,
+        autoTransition = 1 << 3,
+        warmUp = 1 << 4,
+        numTags = 5
+    };
+
+    static String getTagNames(uint32 tags)
+    {
+        static constexpr const char *names[numTags] = {"messages", "quality change", "smoothing", "auto transition", "warm-up"};
+
+        StringArray s;
+        for (int t = 0; t < numTags; ++t)
+            if (tags & (1u << t))
+                s.add(names[t]);
+
+        return s.joinIntoString(", ");
+    }
+
+    /* load bins are binWidth of the budget wide; the last one takes everything beyond */
+    static constexpr int numBins = 101;
+    static constexpr double binWidth = 0.02;
+    /* callbacks over this share of the budget are reported individually */
+    static constexpr double spikeLoad = 0.5;
+
+    struct Spike
+    {
+        uint64 callback;
+        double load;
+        uint32 tags;
+    };
+
+    struct Stats
+    {
+        uint64 callbacks = 0, overruns = 0;
+        double maxLoad = 0.0, p99Load = 0.0;
+        std::array<uint64, numBins> histogram{};
+        /* most recent last */
+        std::vector<Spike> spikes;
+    };
+
+    /* audio thread, once per callback; returns the callback's load */
+    double record(int64 ticks, int numSamples, double sampleRate, uint32 tags)
+    {
+        if (numSamples <= 0 || sampleRate <= 0.0)
+            return 0.0;
+
+        if (resetRequested.exchange(false))
+        {
+            for (auto &b : histogram)
+                b.store(0, std::memory_order_relaxed);
+            callbacks.store(0, std::memory_order_relaxed);
+            overruns.store(0, std::memory_order_relaxed);
+            maxLoad.store(0.0, std::memory_order_relaxed);
+        }
+
+        const auto budget = (double)numSamples / sampleRate;
+        const auto load = Time::highResolutionTicksToSeconds(ticks) / budget;
+
+        const auto bin = jmin(numBins - 1, (int)(load / binWidth));
+        histogram[(size_t)bin].fetch_add(1, std::memory_order_relaxed);
+
+        const auto index = callbacks.fetch_add(1, std::memory_order_relaxed);
+        if (load > 1.0)
+            overruns.fetch_add(1, std::memory_order_relaxed);
+        if (load > maxLoad.load(std::memory_order_relaxed))
+            maxLoad.store(load, std::memory_order_relaxed);
+
+        if (load > spikeLoad)
+        {
+            int start1, size1, start2, size2;
+            spikeFifo.prepareToWrite(1, start1, size1, start2, size2);
+            if (size1 > 0)
+                spikeRing[(size_t)start1] = {index, load, tags};
+            spikeFifo.finishedWrite(size1);
+        }
+
+        return load;
+    }
+
+    /* reader thread */
+    Stats getStats()
+    {
+        int start1, size1, start2, size2;
+        spikeFifo.prepareToRead(spikeFifo.getNumReady(), start1, size1, start2, size2);
+        for (int i = 0; i < size1; ++i)
+            recentSpikes.push_back(spikeRing[(size_t)(start1 + i)]);
+        for (int i = 0; i < size2; ++i)
+            recentSpikes.push_back(spikeRing[(size_t)(start2 + i)]);
+        spikeFifo.finishedRead(size1 + size2);
+
+        while (recentSpikes.size() > maxRecentSpikes)
+            recentSpikes.pop_front();
+
+        Stats stats;
+        uint64 total = 0;
+        for (size_t b = 0; b < histogram.size(); ++b)
+            total += stats.histogram[b] = histogram[b].load(std::memory_order_relaxed);
+
+        stats.callbacks = callbacks.load(std::memory_order_relaxed);
+        stats.overruns = overruns.load(std::memory_order_relaxed);
+        stats.maxLoad = maxLoad.load(std::memory_order_relaxed);
+
+        /* upper edge of the bin holding the 99th percentile, capped by the true max */
+        uint64 count = 0;
+        for (int b = 0; b < numBins && total > 0; ++b)
+        {
+            count += stats.histogram[(size_t)b];
+            if (count * 100 >= total * 99)
+            {
+                stats.p99Load = jmin(stats.maxLoad, (b + 1) * binWidth);
+                break;
+            }
+        }
+
+        stats.spikes.assign(recentSpikes.begin(), recentSpikes.end());
+        return stats;
+    }
+
+    /* reader thread: start over from the next callback */
+    void reset()
+    {
+        resetRequested = true;
+        recentSpikes.clear();
+    }
+
+private:
+    std::array<std::atomic<uint64>, numBins> histogram{};
+    std::atomic<uint64> callbacks{0}, overruns{0};
+    std::atomic<double> maxLoad{0.0};
+    std::atomic<bool> resetRequested{false};
+
+    static constexpr int spikeRingSize = 64;
+    std::array<Spike, spikeRingSize> spikeRing{};
+    AbstractFifo spikeFifo{spikeRingSize};
+
+    static constexpr size_t maxRecentSpikes = 16;
+    std::deque<Spike> recentSpikes;
+};
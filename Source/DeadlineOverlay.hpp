@@ -0,0 +1,59 @@
+// DeadlineOverlay.hpp
+
+#pragma once
+
+/* debug readout of the processor's callback deadlines: max, p99, overruns and the latest spike with its tags. Click to reset */
+struct DeadlineOverlay : Component, private Timer
+{
+    DeadlineOverlay(STRXAudioProcessor &p) : processor(p)
+    {
+        startTimerHz(4);
+    }
+
+    ~DeadlineOverlay() override { stopTimer(); }
+
+    void paint(Graphics &g) override
+    {
+        g.setColour(Colours::black.withAlpha(0.5f));
+        g.fillRect(getLocalBounds());
+        g.setColour(overrunning ? Colours::orangered : Colour(LIGHT_ACCENT));
+        g.setFont((float)getHeight() * 0.8f);
+        g.drawFittedText(text, getLocalBounds().reduced(2, 0), Justification::centredLeft, 1);
+    }
+
+    void mouseDown(const MouseEvent &) override
+    {
+        processor.resetDeadlineStats();
+        timerCallback();
+    }
+
+private:
+    void timerCallback() override
+    {
+        const auto stats = processor.getDeadlineStats();
+
+        String newText;
+        newText << "Max " << String(stats.maxLoad * 100.0, 1) << "%  p99 " << String(stats.p99Load * 100.0, 1) << "%  Overruns "
+                << String((int64)stats.overruns) << "/" << String((int64)stats.callbacks);
+
+        if (!stats.spikes.empty())
+        {
+            const auto &last = stats.spikes.back();
+            newText << "  Last spike " << String(last.load * 100.0, 1) << "% @" << String((int64)last.callback);
+            if (last.tags != 0)
+                newText << " (" << DeadlineMonitor::getTagNames(last.tags) << ")";
+        }
+
+        const auto newOverrunning = stats.overruns > 0;
+        if (newText != text || newOverrunning != overrunning)
+        {
+            text = newText;
+            overrunning = newOverrunning;
+            repaint();
+        }
+    }
+
+    STRXAudioProcessor &processor;
+    String text;
+    bool overrunning = false;
+};
@@ -0,0 +1,130 @@
+// DesignCache.hpp
+
+#pragma once
+
+/**
+ * Process-wide store of immutable filter designs, so instances running at the
+ * same rate and quality compute each design once and share it by reference.
+ * Designs are keyed by kind and up to two parameters (sample rate, or the
+ * transition width and stopband of a halfband) and are held weakly, so they
+ * are freed with the last instance using them. Access it through
+ * SharedResourcePointer.
+ *
+ * A design type needs a constructor taking its key parameters and a
+ * getMemoryFootprint() const returning its size in bytes.
+ */
+class DesignCache
+{
+public:
+    enum class Kind
+    {
+        ampFilters,
+        polyphaseIIR,
+        equirippleFIR
+    };
+
+    struct Stats
+    {
+        uint64 hits = 0, misses = 0;
+        size_t numDesigns = 0;
+        /* bytes of designs currently alive, and the bytes instances would hold if each had its own copy */
+        size_t bytesShared = 0, bytesSaved = 0;
+
+        double getHitRate() const { return hits + misses > 0 ? (double)hits / (double)(hits + misses) : 0.0; }
+    };
+
+    DesignCache() = default;
+
+    /**
+     * The shared design for these parameters, built on a miss. Takes a
+     * process-wide lock and may design a filter, so call it from prepare or
+     * builder threads only and hand the result to the audio thread. The lock
+     * covers the lookup and not the design, so one instance designing doesn't
+     * hold up the others; two missing on the same key at once may both
+     * design it, and the first stored is shared.
+     */
+    template <typename Design, typename... Params>
+    std::shared_ptr<const Design> get(Kind kind, Params... params)
+    {
+        static_assert(sizeof...(Params) <= maxParams, "too many key parameters");
+        const Key key{kind, {{(double)params...}}};
+
+        {
+            const ScopedLock sl(lock);
+            if (auto existing = find(key))
+            {
+                ++hits;
+                return std::static_pointer_cast<const Design>(existing);
+            }
+
+            ++misses;
+        }
+
+        auto design = std::make_shared<const Design>(params...);
+
+        const ScopedLock sl(lock);
+        if (auto existing = find(key))
+            return std::static_pointer_cast<const Design>(existing);
+
+        for (auto e = designs.begin(); e != designs.end();)
+            e = e->second.design.expired() ? designs.erase(e) : std::next(e);
+
+        designs[key] = {design, design->getMemoryFootprint()};
+        return design;
+    }
+
+    Stats getStats() const
+    {
+        const ScopedLock sl(lock);
+
+        Stats stats;
+        stats.hits = hits;
+        stats.misses = misses;
+
+        for (const auto &d : designs)
+        {
+            const auto users = (size_t)d.second.design.use_count();
+            if (users == 0)
+                continue;
+
+            ++stats.numDesigns;
+            stats.bytesShared += d.second.bytes;
+            stats.bytesSaved += d.second.bytes * (users - 1);
+        }
+
+        return stats;
+    }
+
+private:
+    static constexpr size_t maxParams = 2;
+
+    struct Key
+    {
+        Kind kind;
+        std::array<double, maxParams> params;
+
+        bool operator<(const Key &other) const
+        {
+            return std::tie(kind, params) < std::tie(other.kind, other.params);
+        }
+    };
+
+    struct Entry
+    {
+        std::weak_ptr<const void> design;
+        size_t bytes = 0;
+    };
+
+    CriticalSection lock;
+    std::map<Key, Entry> designs;
+    uint64 hits = 0, misses = 0;
+
+    /* call with the lock held */
+    std::shared_ptr<const void> find(const Key &key) const
+    {
+        const auto it = designs.find(key);
+        return it != designs.end() ? it->second.design.lock() : nullptr;
+    }
+
+    JUCE_DECLARE_NON_COPYABLE(DesignCache)
+};
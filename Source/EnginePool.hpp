@@ -0,0 +1,163 @@
+// EnginePool.hpp
+
+#pragma once
+
+#include "PluginProcessor.h"
+
+/**
+ * Prepared processors kept warm between jobs, for services that render many
+ * short requests. Constructing and preparing a processor costs far more than
+ * a short clip takes to render, so engines are handed out by sample rate and
+ * channel count and come back to the pool afterwards, with their quality
+ * engines already built.
+ *
+ * Every engine is handed out in the same condition whatever it ran before:
+ * parameters at their defaults except those given, smoothing settled on them
+ * and the processing state cleared, so a request renders the same on a
+ * reused engine as on a new one. Safe to share between threads.
+ */
+class EnginePool
+{
+public:
+    using Engine = std::unique_ptr<STRXAudioProcessor>;
+    /* parameter IDs and their real values */
+    using Parameters = std::vector<std::pair<String, float>>;
+
+    struct Stats
+    {
+        int created = 0, reused = 0, idle = 0;
+    };
+
+    explicit EnginePool(int maxBlockSizeToUse = 512) : maxBlockSize(maxBlockSizeToUse) {}
+
+    int getMaxBlockSize() const { return maxBlockSize; }
+
+    /* prepare engines ahead of the first requests */
+    void warm(double sampleRate, int numChannels, int count)
+    {
+        std::vector<Engine> engines;
+        for (int i = 0; i < count; ++i)
+            engines.push_back(create(sampleRate, numChannels));
+
+        const ScopedLock sl(lock);
+        for (auto &e : engines)
+            idle[{sampleRate, numChannels}].push_back(std::move(e));
+    }
+
+    /**
+     * An engine at the rate and channel count with the given parameters, or
+     * nullptr if a parameter ID is unknown, naming it in `error`.
+     */
+    Engine acquire(double sampleRate, int numChannels, const Parameters &parameters, String &error)
+    {
+        Engine engine;
+        {
+            const ScopedLock sl(lock);
+            auto &engines = idle[{sampleRate, numChannels}];
+            if (!engines.empty())
+            {
+                engine = std::move(engines.back());
+                engines.pop_back();
+                ++stats.reused;
+            }
+        }
+
+        if (engine == nullptr)
+            engine = create(sampleRate, numChannels);
+
+        for (auto *param : engine->getParameters())
+            param->setValueNotifyingHost(param->getDefaultValue());
+
+        if (!setParameters(*engine, parameters, error))
+        {
+            release(std::move(engine));
+            return nullptr;
+        }
+
+        settle(*engine);
+        return engine;
+    }
+
+    /* back to the pool once the job is done with it */
+    void release(Engine engine)
+    {
+        if (engine == nullptr)
+            return;
+
+        const ScopedLock sl(lock);
+        idle[{engine->getSampleRate(), engine->getTotalNumInputChannels()}].push_back(std::move(engine));
+    }
+
+    /* apply parameter changes mid-job; false naming the first unknown ID in `error` */
+    static bool setParameters(STRXAudioProcessor &engine, const Parameters &parameters, String &error)
+    {
+        for (auto &[id, value] : parameters)
+        {
+            auto *param = engine.apvts.getParameter(id);
+            if (param == nullptr)
+            {
+                error = "unknown parameter " + id;
+                return false;
+            }
+
+            param->setValueNotifyingHost(param->convertTo0to1(value));
+        }
+
+        return true;
+    }
+
+    Stats getStats() const
+    {
+        const ScopedLock sl(lock);
+        auto s = stats;
+        for (auto &entry : idle)
+            s.idle += (int)entry.second.size();
+        return s;
+    }
+
+private:
+    Engine create(double sampleRate, int numChannels)
+    {
+        auto engine = std::make_unique<STRXAudioProcessor>();
+        engine->setNonRealtime(true);
+        engine->setBuildOnDemand(true);
+        engine->setPlayConfigDetails(numChannels, numChannels, sampleRate, maxBlockSize);
+        engine->prepareToPlay(sampleRate, maxBlockSize);
+
+        const ScopedLock sl(lock);
+        ++stats.created;
+        return engine;
+    }
+
+    /**
+     * Run the engine on noise until parameter changes, quality builds and
+     * smoothing have all gone through, then clear what the noise left behind.
+     * Noise above the highest gate threshold, so the gate never skips the chain.
+     */
+    void settle(STRXAudioProcessor &engine)
+    {
+        const auto numSamples = jmax(4 * maxBlockSize, (int)(0.05 * engine.getSampleRate()));
+        AudioBuffer<double> block(engine.getTotalNumInputChannels(), maxBlockSize);
+        MidiBuffer midi;
+        Random random(1);
+
+        for (int done = 0; done < numSamples; done += maxBlockSize)
+        {
+            for (int ch = 0; ch < block.getNumChannels(); ++ch)
+                for (int i = 0; i < maxBlockSize; ++i)
+                    block.setSample(ch, i, random.nextDouble() - 0.5);
+
+            engine.processBlock(block, midi);
+        }
+
+        engine.reset();
+    }
+
+    const int maxBlockSize;
+
+    CriticalSection lock;
+    std::map<std::pair<double, int>, std::vector<Engine>> idle;
+    Stats stats;
+
+    JUCE_DECLARE_NON_COPYABLE(EnginePool)
+};
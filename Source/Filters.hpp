@@ -0,0 +1,147 @@
+// Filters.hpp
+
+#pragma once
+
+/**
+ * Plain filter records used by the amp. Each one holds its coefficients and
+ * state inline with no heap or ref-counting, so a whole engine's filters can
+ * live in one contiguous block (see AmpState).
+ */
+
+/* second order section, transposed direct form II */
+template <typename Type>
+struct Biquad
+{
+    double b0 = 1.0, b1 = 0.0, b2 = 0.0, a1 = 0.0, a2 = 0.0;
+    Type s1 = 0.0, s2 = 0.0;
+
+    /* takes unnormalised { b0, b1, b2, a0, a1, a2 } as returned by dsp::IIR::ArrayCoefficients */
+    void setCoefficients(const std::array<double, 6> &c)
+    {
+        const auto a0 = 1.0 / c[3];
+        b0 = c[0] * a0;
+        b1 = c[1] * a0;
+        b2 = c[2] * a0;
+        a1 = c[4] * a0;
+        a2 = c[5] * a0;
+    }
+
+    /* first order { b0, b1, a0, a1 } */
+    void setCoefficients(const std::array<double, 4> &c)
+    {
+        const auto a0 = 1.0 / c[2];
+        b0 = c[0] * a0;
+        b1 = c[1] * a0;
+        b2 = 0.0;
+        a1 = c[3] * a0;
+        a2 = 0.0;
+    }
+
+    void reset()
+    {
+        s1 = 0.0;
+        s2 = 0.0;
+    }
+
+    /* pairs up the state of two sections, for moving it between engines */
+    template <typename Visit>
+    static void visitState(const Biquad &from, Biquad &to, Visit &&visit)
+    {
+        visit(from.s1, to.s1);
+        visit(from.s2, to.s2);
+    }
+
+    inline Type processSample(Type x)
+    {
+        Type y = b0 * x + s1;
+        s1 = b1 * x - a1 * y + s2;
+        s2 = b2 * x - a2 * y;
+        return y;
+    }
+};
+
+/* first order topology-preserving filter with simultaneous LP/HP outputs */
+template <typename Type>
+struct FirstOrderTPT
+{
+    double G = 0.0;
+    Type s = 0.0;
+
+    void setCutoffFreq(double sampleRate, double freq) { G = getCoefficient(sampleRate, freq); }
+
+    static double getCoefficient(double sampleRate, double freq)
+    {
+        const auto g = std::tan(MathConstants<double>::pi * freq / sampleRate);
+        return g / (1.0 + g);
+    }
+
+    void reset() { s = 0.0; }
+
+    template <typename Visit>
+    static void visitState(const FirstOrderTPT &from, FirstOrderTPT &to, Visit &&visit) { visit(from.s, to.s); }
+
+    inline Type processLowpass(Type x)
+    {
+        Type v = G * (x - s);
+        Type y = v + s;
+        s = y + v;
+        return y;
+    }
+
+    inline Type processHighpass(Type x)
+    {
+        return x - processLowpass(x);
+    }
+};
+
+/* 4th order Linkwitz-Riley crossover, as two cascaded TPT state variable sections */
+template <typename Type>
+struct LinkwitzRiley
+{
+    double g = 0.0, h = 0.0;
+    Type s1 = 0.0, s2 = 0.0, s3 = 0.0, s4 = 0.0;
+
+    void setCutoffFreq(double sampleRate, double freq)
+    {
+        g = std::tan(MathConstants<double>::pi * freq / sampleRate);
+        h = 1.0 / (1.0 + R2 * g + g * g);
+    }
+
+    void reset()
+    {
+        s1 = 0.0;
+        s2 = 0.0;
+        s3 = 0.0;
+        s4 = 0.0;
+    }
+
+    template <typename Visit>
+    static void visitState(const LinkwitzRiley &from, LinkwitzRiley &to, Visit &&visit)
+    {
+        visit(from.s1, to.s1);
+        visit(from.s2, to.s2);
+        visit(from.s3, to.s3);
+        visit(from.s4, to.s4);
+    }
+
+    inline void processSample(Type x, Type &outLow, Type &outHigh)
+    {
+        Type yH = (x - (R2 + g) * s1 - s2) * h;
+        Type yB = g * yH + s1;
+        s1 = g * yH + yB;
+        Type yL = g * yB + s2;
+        s2 = g * yB + yL;
+
+        Type yH2 = (yL - (R2 + g) * s3 - s4) * h;
+        Type yB2 = g * yH2 + s3;
+        s3 = g * yH2 + yB2;
+        Type yL2 = g * yB2 + s4;
+        s4 = g * yB2 + yL2;
+
+        outLow = yL2;
+        outHigh = yL - R2 * yB + yH - yL2;
+    }
+
+private:
+    static constexpr double R2 = 1.4142135623730951;
+};
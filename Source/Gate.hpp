@@ -0,0 +1,175 @@
+// Gate.hpp
+
+#pragma once
+
+/**
+ * Input noise gate, run at the host rate in front of the amp. Levels are
+ * detected as the vectorised peak of each sub-block across all channels,
+ * followed by a peak-hold envelope with hysteresis between the open and close
+ * thresholds. The gain ramps linearly within each sub-block, and sub-blocks
+ * where the gain is fully closed are flagged so the chain after the gate can
+ * be skipped for them.
+ */
+class NoiseGate
+{
+public:
+    NoiseGate() = default;
+
+    static constexpr size_t subBlockSize = 32;
+
+    void prepare(const dsp::ProcessSpec &spec)
+    {
+        const auto subBlockRate = spec.sampleRate / (double)subBlockSize;
+        attackCoeff = 1.0 - std::exp(-1.0 / (attackTime * subBlockRate));
+        releaseCoeff = 1.0 - std::exp(-1.0 / (releaseTime * subBlockRate));
+        envelopeDecay = std::exp(-1.0 / (envelopeTime * subBlockRate));
+        holdSubBlocks = (int)std::ceil(holdTime * subBlockRate);
+
+        closed.resize((spec.maximumBlockSize + subBlockSize - 1) / subBlockSize);
+        reset();
+    }
+
+    void reset()
+    {
+        envelope = 0.0;
+        gain = isEnabled() ? 0.0 : 1.0;
+        open = false;
+        holdCounter = 0;
+        std::fill(closed.begin(), closed.end(), false);
+    }
+
+    /* threshold in dB; at or below offThreshold the gate is disabled */
+    void setThreshold(float thresholdDB)
+    {
+        threshold = thresholdDB;
+        openLevel = Decibels::decibelsToGain((double)thresholdDB);
+        closeLevel = Decibels::decibelsToGain((double)thresholdDB - hysteresisDB);
+    }
+
+    bool isEnabled() const { return threshold > offThreshold; }
+
+    void process(dsp::AudioBlock<double> &block)
+    {
+        const auto numSamples = block.getNumSamples();
+        const auto numSubBlocks = (numSamples + subBlockSize - 1) / subBlockSize;
+
+        if (!isEnabled())
+        {
+            gain = 1.0;
+            std::fill(closed.begin(), closed.begin() + (long)numSubBlocks, false);
+            return;
+        }
+
+        for (size_t sb = 0; sb < numSubBlocks; ++sb)
+        {
+            const auto start = sb * subBlockSize;
+            const auto n = jmin(subBlockSize, numSamples - start);
+
+            double peak = 0.0;
+            for (size_t ch = 0; ch < block.getNumChannels(); ++ch)
+                peak = jmax(peak, getPeak(block.getChannelPointer(ch) + start, n));
+
+            envelope = jmax(peak, envelope * envelopeDecay);
+
+            if (envelope > openLevel)
+            {
+                open = true;
+                holdCounter = holdSubBlocks;
+            }
+            else if (envelope < closeLevel)
+            {
+                if (holdCounter > 0)
+                    --holdCounter;
+                else
+                    open = false;
+            }
+
+            const auto startGain = gain;
+            if (open)
+            {
+                gain += (1.0 - gain) * attackCoeff;
+                if (gain > 1.0 - closedGain)
+                    gain = 1.0;
+            }
+            else
+            {
+                gain -= gain * releaseCoeff;
+                if (gain < closedGain)
+                    gain = 0.0;
+            }
+
+            closed[sb] = startGain == 0.0 && gain == 0.0;
+
+            if (startGain == 1.0 && gain == 1.0)
+                continue;
+
+            const auto step = (gain - startGain) / (double)n;
+            for (size_t ch = 0; ch < block.getNumChannels(); ++ch)
+            {
+                auto *x = block.getChannelPointer(ch) + start;
+                for (size_t i = 0; i < n; ++i)
+                    x[i] *= startGain + step * (double)(i + 1);
+            }
+        }
+    }
+
+    /* true if the gate output was silent for the whole of sub-block `index` of the last block */
+    bool isClosed(size_t index) const { return closed[index]; }
+
+    static constexpr float offThreshold = -90.f;
+
+    /* what carries over between blocks */
+    struct Checkpoint
+    {
+        double envelope, gain;
+        bool open;
+        int holdCounter;
+    };
+
+    void saveCheckpoint(Checkpoint &c) const
+    {
+        c.envelope = envelope;
+        c.gain = gain;
+        c.open = open;
+        c.holdCounter = holdCounter;
+    }
+
+    void restoreCheckpoint(const Checkpoint &c)
+    {
+        envelope = c.envelope;
+        gain = c.gain;
+        open = c.open;
+        holdCounter = c.holdCounter;
+    }
+
+private:
+    /* vectorised absolute peak; the tail that doesn't fill a vector is done scalar */
+    static double getPeak(const double *x, size_t n)
+    {
+        const auto numVectors = n / vec::size;
+        vec peakV = 0.0;
+        for (size_t i = 0; i < numVectors; ++i)
+            peakV = xsimd::max(peakV, xsimd::abs(xsimd::load_unaligned(x + i * vec::size)));
+
+        double peak = xsimd::reduce_max(peakV);
+        for (size_t i = numVectors * vec::size; i < n; ++i)
+            peak = jmax(peak, std::abs(x[i]));
+
+        return peak;
+    }
+
+    static constexpr double attackTime = 0.0005, releaseTime = 0.05, envelopeTime = 0.01, holdTime = 0.05;
+    static constexpr double hysteresisDB = 6.0;
+    static constexpr double closedGain = 1.0e-5;
+
+    float threshold = offThreshold;
+    double openLevel = 0.0, closeLevel = 0.0;
+    double attackCoeff = 1.0, releaseCoeff = 1.0, envelopeDecay = 0.0;
+    int holdSubBlocks = 0;
+
+    double envelope = 0.0, gain = 1.0;
+    bool open = false;
+    int holdCounter = 0;
+
+    std::vector<bool> closed;
+};
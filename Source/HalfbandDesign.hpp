@@ -0,0 +1,220 @@
+// HalfbandDesign.hpp
+
+#pragma once
+
+/**
+ * Compile-time design of the polyphase IIR halfbands the realtime
+ * oversamplers run, by the same allpass method dsp::FilterDesign uses at
+ * runtime. Every realtime stage's settings are fixed (getHalfbandSettings),
+ * so their coefficients are built into the binary rather than designed by
+ * the first instance to need them; any other settings fall back to
+ * dsp::FilterDesign. Debug builds check each precomputed design against
+ * dsp::FilterDesign's when an oversampler first uses it.
+ */
+
+/* what the design needs from <cmath>, as constexpr series accurate to a few ulp over the ranges it's used in */
+struct ConstexprMath
+{
+    static constexpr double pi = 3.14159265358979323846;
+    static constexpr double ln2 = 0.69314718055994530942;
+
+    static constexpr double abs(double x) { return x < 0.0 ? -x : x; }
+
+    static constexpr double ipow(double x, int n)
+    {
+        double r = 1.0;
+        for (int i = 0; i < n; ++i)
+            r *= x;
+        return r;
+    }
+
+    static constexpr double round(double x) { return (double)(long long)(x < 0.0 ? x - 0.5 : x + 0.5); }
+
+    static constexpr int ceil(double x)
+    {
+        const auto n = (int)x;
+        return (double)n < x ? n + 1 : n;
+    }
+
+    static constexpr double sqrt(double x)
+    {
+        if (x <= 0.0)
+            return 0.0;
+
+        double r = x > 1.0 ? x : 1.0;
+        for (int i = 0; i < 200; ++i)
+        {
+            const auto next = 0.5 * (r + x / r);
+            if (next == r)
+                break;
+            r = next;
+        }
+        return r;
+    }
+
+    static constexpr double sin(double x)
+    {
+        x -= 2.0 * pi * round(x / (2.0 * pi));
+        double term = x, sum = x;
+        for (int k = 1; k < 30; ++k)
+        {
+            term *= -x * x / ((2.0 * k) * (2.0 * k + 1.0));
+            sum += term;
+        }
+        return sum;
+    }
+
+    static constexpr double cos(double x)
+    {
+        x -= 2.0 * pi * round(x / (2.0 * pi));
+        double term = 1.0, sum = 1.0;
+        for (int k = 1; k < 30; ++k)
+        {
+            term *= -x * x / ((2.0 * k - 1.0) * (2.0 * k));
+            sum += term;
+        }
+        return sum;
+    }
+
+    static constexpr double tan(double x) { return sin(x) / cos(x); }
+
+    /* x > 0: scaled into [1, 2), then 2 atanh((x - 1) / (x + 1)) */
+    static constexpr double log(double x)
+    {
+        int e = 0;
+        for (; x >= 2.0; x *= 0.5)
+            ++e;
+        for (; x < 1.0; x *= 2.0)
+            --e;
+
+        const auto y = (x - 1.0) / (x + 1.0);
+        double power = y, sum = 0.0;
+        for (int k = 0; k < 40; ++k)
+        {
+            sum += power / (2.0 * k + 1.0);
+            power *= y * y;
+        }
+        return 2.0 * sum + e * ln2;
+    }
+
+    /* 2^k e^r with |r| <= ln2 / 2 */
+    static constexpr double exp(double x)
+    {
+        const auto k = (int)round(x / ln2);
+        const auto r = x - k * ln2;
+
+        double term = 1.0, sum = 1.0;
+        for (int n = 1; n < 30; ++n)
+        {
+            term *= r / n;
+            sum += term;
+        }
+
+        for (int i = 0; i < k; ++i)
+            sum *= 2.0;
+        for (int i = 0; i > k; --i)
+            sum *= 0.5;
+        return sum;
+    }
+};
+
+/* allpass coefficients of the two branches, as dsp::FilterDesign's direct path and delayed path after its z^-1 */
+struct HalfbandCoefficients
+{
+    static constexpr int maxPerBranch = 16;
+
+    double transitionWidth = 0.0, stopbandDB = 0.0;
+    int numDirect = 0, numDelayed = 0;
+    std::array<double, maxPerBranch> direct{}, delayed{};
+};
+
+/* dsp::FilterDesign<double>::designIIRLowpassHalfBandPolyphaseAllpassMethod, at compile time */
+static constexpr HalfbandCoefficients designHalfband(double transitionWidth, double stopbandDB)
+{
+    using M = ConstexprMath;
+
+    const auto wt = 2.0 * M::pi * transitionWidth;
+    const auto ds = M::exp(stopbandDB / 20.0 * M::log(10.0));
+
+    const auto t = M::tan((M::pi - wt) / 4.0);
+    const auto k = t * t;
+    const auto kp = M::sqrt(1.0 - k * k);
+    const auto e = (1.0 - M::sqrt(kp)) / (1.0 + M::sqrt(kp)) * 0.5;
+    const auto q = e + 2.0 * M::ipow(e, 5) + 15.0 * M::ipow(e, 9) + 150.0 * M::ipow(e, 13);
+
+    const auto k1 = ds * ds / (1.0 - ds * ds);
+    auto n = M::ceil(M::log(k1 * k1 / 16.0) / M::log(q));
+    if (n % 2 == 0)
+        ++n;
+    if (n == 1)
+        n = 3;
+
+    HalfbandCoefficients c;
+    c.transitionWidth = transitionWidth;
+    c.stopbandDB = stopbandDB;
+
+    for (int i = 1; i <= (n - 1) / 2; ++i)
+    {
+        double num = 0.0, delta = 1.0;
+        for (int m = 0; M::abs(delta) > 1.0e-100; ++m)
+        {
+            delta = (m % 2 ? -1.0 : 1.0) * M::ipow(q, m * (m + 1)) * M::sin((2 * m + 1) * M::pi * i / n);
+            num += delta;
+        }
+        num *= 2.0 * M::sqrt(M::sqrt(q));
+
+        double den = 0.0;
+        delta = 1.0;
+        for (int m = 1; M::abs(delta) > 1.0e-100; ++m)
+        {
+            delta = (m % 2 ? -1.0 : 1.0) * M::ipow(q, m * m) * M::cos(m * 2.0 * M::pi * i / n);
+            den += delta;
+        }
+        den = 1.0 + 2.0 * den;
+
+        const auto wi = num / den;
+        const auto api = M::sqrt((1.0 - wi * wi * k) * (1.0 - wi * wi / k)) / (1.0 + wi * wi);
+        const auto a = (1.0 - api) / (1.0 + api);
+
+        /* alternate branches, starting with the direct one */
+        if (i % 2)
+            c.direct[(size_t)c.numDirect++] = a;
+        else
+            c.delayed[(size_t)c.numDelayed++] = a;
+    }
+
+    return c;
+}
+
+/* transition widths and stopbands of oversampling stage `stage`, counted from the base rate */
+struct HalfbandSettings
+{
+    double twUp, dBUp, twDown, dBDown;
+};
+
+static constexpr HalfbandSettings getHalfbandSettings(size_t stage, bool maxQuality)
+{
+    return {(maxQuality ? 0.10 : 0.12) * (stage == 0 ? 0.5 : 1.0),
+            (maxQuality ? -90.0 : -70.0) + (maxQuality ? 10.0 : 8.0) * (double)stage,
+            (maxQuality ? 0.12 : 0.15) * (stage == 0 ? 0.5 : 1.0),
+            (maxQuality ? -75.0 : -60.0) + (maxQuality ? 10.0 : 8.0) * (double)stage};
+}
+
+/* up and down designs of the first two stages, every polyphase IIR design the processor asks for except fixed rate's third stage at 22.05 and 24 kHz */
+static constexpr std::array<HalfbandCoefficients, 4> precomputedHalfbands{
+    designHalfband(getHalfbandSettings(0, false).twUp, getHalfbandSettings(0, false).dBUp),
+    designHalfband(getHalfbandSettings(0, false).twDown, getHalfbandSettings(0, false).dBDown),
+    designHalfband(getHalfbandSettings(1, false).twUp, getHalfbandSettings(1, false).dBUp),
+    designHalfband(getHalfbandSettings(1, false).twDown, getHalfbandSettings(1, false).dBDown)};
+
+static_assert(precomputedHalfbands[0].numDirect > 0 && precomputedHalfbands[3].numDirect > 0, "halfband design failed");
+
+/* the compile-time design for these settings, or nullptr if there isn't one */
+static const HalfbandCoefficients *findPrecomputedHalfband(double transitionWidth, double stopbandDB)
+{
+    for (auto &c : precomputedHalfbands)
+        if (c.transitionWidth == transitionWidth && c.stopbandDB == stopbandDB)
+            return &c;
+
+    return nullptr;
+}
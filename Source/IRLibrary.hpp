@@ -0,0 +1,370 @@
+// IRLibrary.hpp
+
+#pragma once
+
+/**
+ * Process-wide store of prepared cabinet responses. IR files are memory-mapped
+ * and identified by a hash of their contents, and their partition spectra are
+ * cached on disk per content, sample rate and partition size, so recalling a
+ * session maps the spectra straight from the cache instead of decoding and
+ * transforming the IR again. Responses in use are shared read-only between
+ * every instance in the process; access it through SharedResourcePointer.
+ *
+ * The disk cache is held to cacheCapacity bytes, least recently used first.
+ * Recency is kept in the files' modification times, so it carries over
+ * between sessions, and the cache is trimmed when the library is created and
+ * after each new file.
+ */
+class IRLibrary
+{
+public:
+    IRLibrary() { trimCache(); }
+
+    /**
+     * Response for an IR file at the given rate and block size. If the file is
+     * missing, the cache is searched for `contentHash` instead, and with no
+     * file and no hash the built-in response is returned. Returns nullptr if
+     * nothing usable is found. The lock only covers the lookup, so decoding
+     * and transforming an IR never holds up other instances; two asking for
+     * the same new response at once may both build it, and the first one
+     * stored is shared.
+     */
+    std::shared_ptr<const CabinetResponse> getResponse(const File &file, uint64 contentHash, double sampleRate, int maximumBlockSize)
+    {
+        const auto headBlockSize = CabinetResponse::getHeadBlockSize(maximumBlockSize);
+
+        std::unique_ptr<MemoryMappedFile> source;
+        if (file.existsAsFile())
+        {
+            source = std::make_unique<MemoryMappedFile>(file, MemoryMappedFile::readOnly);
+            if (source->getData() == nullptr)
+                return nullptr;
+
+            contentHash = hashBytes(source->getData(), source->getSize());
+        }
+
+        const auto key = String::toHexString((int64)contentHash) + "_" + String(roundToInt(sampleRate)) + "_" + String((int)headBlockSize);
+
+        {
+            const ScopedLock sl(lock);
+            if (auto existing = findResponse(key))
+                return existing;
+        }
+
+        std::shared_ptr<const CabinetResponse> response;
+        if (contentHash == 0)
+        {
+            auto ir = makeDefaultResponse(sampleRate);
+            normalise(ir);
+            response = std::make_shared<CabinetResponse>(ir, headBlockSize, 0);
+        }
+        else
+        {
+            const auto cacheFile = getCacheDirectory().getChildFile(key + ".strxir");
+            response = loadCache(cacheFile, contentHash, sampleRate, headBlockSize);
+
+            if (response == nullptr && source != nullptr)
+            {
+                auto ir = decode(*source, sampleRate);
+                if (ir.getNumSamples() == 0)
+                    return nullptr;
+
+                normalise(ir);
+                auto newResponse = std::make_shared<CabinetResponse>(ir, headBlockSize, contentHash);
+                saveCache(cacheFile, *newResponse, sampleRate);
+                trimCache();
+                response = std::move(newResponse);
+            }
+        }
+
+        if (response == nullptr)
+            return nullptr;
+
+        const ScopedLock sl(lock);
+        if (auto existing = findResponse(key))
+            return existing;
+
+        for (auto it = responses.begin(); it != responses.end();)
+            it = it->second.expired() ? responses.erase(it) : std::next(it);
+
+        responses[key] = response;
+        return response;
+    }
+
+    /* content hash of a file, 0 if it can't be read */
+    static uint64 hashFile(const File &file)
+    {
+        MemoryMappedFile map(file, MemoryMappedFile::readOnly);
+        if (map.getData() == nullptr)
+            return 0;
+
+        return hashBytes(map.getData(), map.getSize());
+    }
+
+    static File getCacheDirectory()
+    {
+        return File::getSpecialLocation(File::userApplicationDataDirectory)
+            .getChildFile("Arboreal Audio")
+            .getChildFile("STR-X")
+            .getChildFile("IRCache");
+    }
+
+private:
+    /* call with the lock held */
+    std::shared_ptr<const CabinetResponse> findResponse(const String &key) const
+    {
+        const auto it = responses.find(key);
+        return it != responses.end() ? it->second.lock() : nullptr;
+    }
+
+    /* 64-bit FNV-1a, never 0 so 0 can mean "built-in" */
+    static uint64 hashBytes(const void *data, size_t size)
+    {
+        uint64 h = 14695981039346656037ull;
+        auto *bytes = static_cast<const uint8 *>(data);
+        for (size_t i = 0; i < size; ++i)
+        {
+            h ^= bytes[i];
+            h *= 1099511628211ull;
+        }
+
+        return h != 0 ? h : 1;
+    }
+
+    struct CacheHeader
+    {
+        char magic[8];
+        uint32 version, numChannels, headBlockSize, irSize;
+        uint64 hash;
+        double sampleRate;
+        uint8 padding[24];
+    };
+
+    /* keeps the planes following the header on 64-byte boundaries */
+    static_assert(sizeof(CacheHeader) == 64, "IR cache header must be one cache line");
+
+    static constexpr char cacheMagic[8] = {'S', 'T', 'R', 'X', 'I', 'R', 'C', 0};
+    /* 2: resampled IRs are band-limited and no longer delayed, so older spectra are rebuilt */
+    static constexpr uint32 cacheVersion = 2;
+    static constexpr int64 cacheCapacity = (int64)256 << 20;
+
+    /* delete the least recently used cache files past cacheCapacity; a file another instance has mapped may stay until next time */
+    static void trimCache()
+    {
+        auto files = getCacheDirectory().findChildFiles(File::findFiles, false, "*.strxir");
+        std::sort(files.begin(), files.end(), [](const File &x, const File &y)
+                  { return y.getLastModificationTime() < x.getLastModificationTime(); });
+
+        int64 totalBytes = 0;
+        for (auto &f : files)
+        {
+            totalBytes += f.getSize();
+            if (totalBytes > cacheCapacity)
+                f.deleteFile();
+        }
+    }
+
+    static std::shared_ptr<const CabinetResponse> loadCache(const File &cacheFile, uint64 hash, double sampleRate, size_t headBlockSize)
+    {
+        if (!cacheFile.existsAsFile())
+            return nullptr;
+
+        auto map = std::make_unique<MemoryMappedFile>(cacheFile, MemoryMappedFile::readOnly);
+        if (map->getData() == nullptr || map->getSize() < sizeof(CacheHeader))
+            return nullptr;
+
+        CacheHeader header;
+        std::memcpy(&header, map->getData(), sizeof(CacheHeader));
+
+        if (std::memcmp(header.magic, cacheMagic, sizeof(cacheMagic)) != 0
+            || header.version != cacheVersion
+            || header.hash != hash
+            || header.sampleRate != sampleRate
+            || header.headBlockSize != headBlockSize
+            || header.numChannels < 1 || header.numChannels > 2)
+            return nullptr;
+
+        const auto dataSize = CabinetResponse::getDataSize(header.numChannels, header.irSize, headBlockSize);
+        if (map->getSize() != sizeof(CacheHeader) + dataSize * sizeof(float))
+            return nullptr;
+
+        /* a hit makes it the most recently used */
+        cacheFile.setLastModificationTime(Time::getCurrentTime());
+
+        auto *planes = reinterpret_cast<const float *>(static_cast<const char *>(map->getData()) + sizeof(CacheHeader));
+        return std::make_shared<CabinetResponse>(std::move(map), planes, header.numChannels, header.irSize, headBlockSize, hash);
+    }
+
+    static void saveCache(const File &cacheFile, const CabinetResponse &response, double sampleRate)
+    {
+        if (cacheFile.getParentDirectory().createDirectory().failed())
+            return;
+
+        CacheHeader header{};
+        std::memcpy(header.magic, cacheMagic, sizeof(cacheMagic));
+        header.version = cacheVersion;
+        header.numChannels = (uint32)response.getNumChannels();
+        header.headBlockSize = (uint32)response.headBlockSize;
+        header.irSize = (uint32)response.irSize;
+        header.hash = response.hash;
+        header.sampleRate = sampleRate;
+
+        /* write to a temp file and move it in place, so other instances never map a partial file */
+        const auto temp = cacheFile.getNonexistentSibling();
+        {
+            FileOutputStream out(temp);
+            if (!out.openedOk())
+                return;
+
+            out.write(&header, sizeof(header));
+            for (size_t ch = 0; ch < response.getNumChannels(); ++ch)
+            {
+                const auto &head = *response.heads[ch];
+                out.write(head.getReal(0), head.getPlaneSize() * sizeof(float));
+                out.write(head.getImag(0), head.getPlaneSize() * sizeof(float));
+
+                if (!response.tails.empty())
+                {
+                    const auto &tail = *response.tails[ch];
+                    out.write(tail.getReal(0), tail.getPlaneSize() * sizeof(float));
+                    out.write(tail.getImag(0), tail.getPlaneSize() * sizeof(float));
+                }
+            }
+
+            out.flush();
+            if (out.getStatus().failed())
+            {
+                temp.deleteFile();
+                return;
+            }
+        }
+
+        if (!temp.moveFileTo(cacheFile))
+            temp.deleteFile();
+    }
+
+    /* decode the mapped file, keeping at most two channels and one second, at the processing rate */
+    static AudioBuffer<float> decode(const MemoryMappedFile &source, double sampleRate)
+    {
+        AudioFormatManager formats;
+        formats.registerBasicFormats();
+
+        std::unique_ptr<AudioFormatReader> reader(formats.createReaderFor(std::make_unique<MemoryInputStream>(source.getData(), source.getSize(), false)));
+        if (reader == nullptr || reader->lengthInSamples <= 0 || reader->sampleRate <= 0.0)
+            return {};
+
+        AudioBuffer<float> ir((int)jmin(reader->numChannels, 2u), (int)jmin(reader->lengthInSamples, (int64)(reader->sampleRate * maxLengthSeconds)));
+        reader->read(&ir, 0, ir.getNumSamples(), 0, true, true);
+
+        return resample(ir, reader->sampleRate, sampleRate);
+    }
+
+    /**
+     * Windowed-sinc resampling, summed directly at each output sample. The
+     * cutoff sits just under the lower of the two Nyquist rates, so lowering
+     * the rate doesn't alias, and the Blackman-windowed kernel is centred on
+     * the read position, so the response comes out undelayed.
+     */
+    static AudioBuffer<float> resample(const AudioBuffer<float> &ir, double irSampleRate, double sampleRate)
+    {
+        const auto ratio = irSampleRate / sampleRate;
+        const auto numSamples = jmin((int)std::ceil(ir.getNumSamples() / ratio), (int)(maxLengthSeconds * sampleRate));
+
+        AudioBuffer<float> out(ir.getNumChannels(), numSamples);
+        if (ratio == 1.0)
+        {
+            for (int ch = 0; ch < ir.getNumChannels(); ++ch)
+                out.copyFrom(ch, 0, ir, ch, 0, numSamples);
+            return out;
+        }
+
+        /* both relative to the source: cutoff as a fraction of its Nyquist, halfWidth in its samples */
+        const auto cutoff = resampleCutoff * jmin(1.0, 1.0 / ratio);
+        const auto halfWidth = resampleZeroCrossings / cutoff;
+        const auto irLength = ir.getNumSamples();
+        constexpr auto pi = MathConstants<double>::pi;
+
+        for (int ch = 0; ch < ir.getNumChannels(); ++ch)
+        {
+            auto *x = ir.getReadPointer(ch);
+            auto *y = out.getWritePointer(ch);
+
+            for (int n = 0; n < numSamples; ++n)
+            {
+                const auto t = n * ratio;
+                const auto first = jmax(0, (int)std::ceil(t - halfWidth));
+                const auto last = jmin(irLength - 1, (int)std::floor(t + halfWidth));
+
+                double sum = 0.0;
+                for (int k = first; k <= last; ++k)
+                {
+                    const auto d = k - t;
+                    const auto window = 0.42 + 0.5 * std::cos(pi * d / halfWidth) + 0.08 * std::cos(2.0 * pi * d / halfWidth);
+                    const auto a = pi * cutoff * d;
+                    sum += x[k] * window * (a == 0.0 ? 1.0 : std::sin(a) / a);
+                }
+
+                y[n] = (float)(cutoff * sum);
+            }
+        }
+
+        return out;
+    }
+
+    /* unit energy, so white noise passes at the same level whichever response is loaded */
+    static void normalise(AudioBuffer<float> &ir)
+    {
+        for (int ch = 0; ch < ir.getNumChannels(); ++ch)
+        {
+            auto *x = ir.getWritePointer(ch);
+            double energy = 0.0;
+            for (int i = 0; i < ir.getNumSamples(); ++i)
+                energy += (double)x[i] * x[i];
+
+            if (energy > 0.0)
+                FloatVectorOperations::multiply(x, (float)(1.0 / std::sqrt(energy)), ir.getNumSamples());
+        }
+    }
+
+    /* a closed-back 4x12 approximation: low thump, upper-mid cone peak, steep rolloff above 5k */
+    static AudioBuffer<float> makeDefaultResponse(double sampleRate)
+    {
+        using Coeffs = dsp::IIR::ArrayCoefficients<double>;
+
+        std::array<Biquad<double>, 6> stages;
+        stages[0].setCoefficients(Coeffs::makeHighPass(sampleRate, 75.0, 0.7));
+        stages[1].setCoefficients(Coeffs::makePeakFilter(sampleRate, 110.0, 1.2, Decibels::decibelsToGain(4.0)));
+        stages[2].setCoefficients(Coeffs::makePeakFilter(sampleRate, 450.0, 1.0, Decibels::decibelsToGain(-3.0)));
+        stages[3].setCoefficients(Coeffs::makePeakFilter(sampleRate, 2800.0, 1.5, Decibels::decibelsToGain(3.0)));
+        stages[4].setCoefficients(Coeffs::makeLowPass(sampleRate, 5000.0, 0.54));
+        stages[5].setCoefficients(Coeffs::makeLowPass(sampleRate, 5000.0, 1.31));
+
+        AudioBuffer<float> ir(1, (int)(defaultLengthSeconds * sampleRate));
+        auto *x = ir.getWritePointer(0);
+        const auto numSamples = ir.getNumSamples();
+        const auto fadeStart = numSamples * 3 / 4;
+
+        for (int i = 0; i < numSamples; ++i)
+        {
+            double y = i == 0 ? 1.0 : 0.0;
+            for (auto &s : stages)
+                y = s.processSample(y);
+
+            if (i >= fadeStart)
+                y *= 0.5 * (1.0 + std::cos(MathConstants<double>::pi * (i - fadeStart) / (numSamples - fadeStart)));
+
+            x[i] = (float)y;
+        }
+
+        return ir;
+    }
+
+    static constexpr double maxLengthSeconds = 1.0, defaultLengthSeconds = 0.1;
+    /* resampling kernel: zero crossings either side, and cutoff below the lower Nyquist rate */
+    static constexpr double resampleZeroCrossings = 32.0, resampleCutoff = 0.95;
+
+    CriticalSection lock;
+    std::map<String, std::weak_ptr<const CabinetResponse>> responses;
+
+    JUCE_DECLARE_NON_COPYABLE(IRLibrary)
+};
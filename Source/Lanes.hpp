@@ -0,0 +1,93 @@
+// Lanes.hpp
+
+#pragma once
+
+/**
+ * Packs up to vec::size planar channels into the lanes of a single vec
+ * stream, so one SIMD amp engine serves mono and stereo alike. Lanes beyond
+ * the active channel count are zero and are never written back. Mono pays for
+ * the full vector width with its idle lanes, which costs about what the old
+ * scalar path did on one channel; packing streams together (BatchEngine) is
+ * what fills them.
+ */
+class LaneBuffer
+{
+public:
+    /* the block interface AmpProcessor::processAmp expects, over one vec channel */
+    struct Block
+    {
+        vec *data;
+        size_t numSamples;
+
+        size_t getNumChannels() const { return 1; }
+        vec *getChannelPointer(size_t) const { return data; }
+        size_t getNumSamples() const { return numSamples; }
+    };
+
+    void setSize(size_t maxSamples) { buffer.resize(maxSamples); }
+    size_t getSize() const { return buffer.size(); }
+
+    vec *data() { return buffer.data(); }
+
+    Block interleave(const dsp::AudioBlock<double> &block)
+    {
+        const auto numSamples = jmin(block.getNumSamples(), buffer.size());
+
+        for (size_t i = 0; i < numSamples; ++i)
+            buffer[i] = gather(block, i);
+
+        return {buffer.data(), numSamples};
+    }
+
+    void deinterleave(const Block &lanesBlock, dsp::AudioBlock<double> &block)
+    {
+        for (size_t i = 0; i < lanesBlock.numSamples; ++i)
+            scatter(lanesBlock.data[i], block, i);
+    }
+
+    /* sample i of every planar channel, one per lane */
+    static vec gather(const dsp::AudioBlock<double> &block, size_t i)
+    {
+        const auto numChannels = jmin(block.getNumChannels(), (size_t)vec::size);
+
+        double lanes[vec::size] = {};
+        for (size_t ch = 0; ch < numChannels; ++ch)
+            lanes[ch] = block.getChannelPointer(ch)[i];
+
+        return xsimd::load_unaligned(lanes);
+    }
+
+    /* one lane of x, and x with one lane replaced; for moving a stream's state between engines */
+    static double getLane(vec x, size_t lane)
+    {
+        double lanes[vec::size];
+        xsimd::store_unaligned(lanes, x);
+        return lanes[lane];
+    }
+
+    static void setLane(vec &x, size_t lane, double value)
+    {
+        double lanes[vec::size];
+        xsimd::store_unaligned(lanes, x);
+        lanes[lane] = value;
+        x = xsimd::load_unaligned(lanes);
+    }
+
+    /* a scalar engine has the one lane */
+    static double getLane(double x, size_t) { return x; }
+    static void setLane(double &x, size_t, double value) { x = value; }
+
+    /* lanes of x back to sample i of each planar channel */
+    static void scatter(vec x, dsp::AudioBlock<double> &block, size_t i)
+    {
+        const auto numChannels = jmin(block.getNumChannels(), (size_t)vec::size);
+
+        double lanes[vec::size];
+        xsimd::store_unaligned(lanes, x);
+        for (size_t ch = 0; ch < numChannels; ++ch)
+            block.getChannelPointer(ch)[i] = lanes[ch];
+    }
+
+private:
+    std::vector<vec, xsimd::aligned_allocator<vec>> buffer;
+};
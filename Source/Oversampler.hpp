@@ -0,0 +1,608 @@
+// Oversampler.hpp
+
+#pragma once
+
+/**
+ * Cascade of 2x halfband stages working directly on lane-packed data. The
+ * first upsampling stage gathers the planar input into lanes as it filters,
+ * and the last downsampling stage scatters its output back to planar, so the
+ * oversampled signal is never copied between layouts on its way through the
+ * amp. Filters are designed with the same settings dsp::Oversampling uses:
+ * polyphase IIR allpass pairs for realtime, equiripple FIRs for offline
+ * quality, and shared between instances through DesignCache. The realtime
+ * designs are computed at compile time (HalfbandDesign.hpp). A first order
+ * Thiran allpass and a delay line pad the latency to
+ * whole samples, or to a longer target so oversamplers of different factors
+ * can be switched between without the reported latency changing. With no
+ * stages it only packs and unpacks the lanes.
+ */
+class LaneOversampler
+{
+public:
+    enum class FilterType
+    {
+        polyphaseIIR,
+        equirippleFIR
+    };
+
+    LaneOversampler(DesignCache &designs, size_t numStagesToUse, FilterType filterType, bool maxQuality)
+        : type(filterType), numStages(numStagesToUse)
+    {
+        for (size_t n = 0; n < numStages; ++n)
+        {
+            const auto s = getHalfbandSettings(n, maxQuality);
+
+            if (type == FilterType::polyphaseIIR)
+                iirStages.emplace_back(designs, s.twUp, s.dBUp, s.twDown, s.dBDown);
+            else
+                firStages.emplace_back(designs, s.twUp, s.dBUp, s.twDown, s.dBDown);
+        }
+
+        /* each stage's latency is in its own output rate, so scale it back to the base rate */
+        for (size_t n = 0; n < numStages; ++n)
+        {
+            const auto stageLatency = type == FilterType::polyphaseIIR ? iirStages[n].getLatency() : firStages[n].getLatency();
+            filterLatency += stageLatency / (double)(2 << n);
+        }
+
+        /* rounded up as dsp::Oversampling does, taking the next sample up where the Thiran allpass would fall under thiranMinimum */
+        auto padding = 1.0 - (filterLatency - std::floor(filterLatency));
+        if (std::abs(padding - 1.0) < minFraction)
+            padding = 0.0;
+        else if (padding < thiranMinimum)
+            padding += 1.0;
+
+        setTargetLatency(filterLatency + padding);
+
+        buffers.resize(jmax(numStages, (size_t)1));
+    }
+
+    size_t getOversamplingFactor() const { return (size_t)1 << numStages; }
+
+    /* whole samples at the base rate */
+    double getLatencyInSamples() const { return std::round(filterLatency + fractionalDelay + (double)integerDelay); }
+
+    /* delay of the filters alone, before padding */
+    double getFilterLatency() const { return filterLatency; }
+
+    /**
+     * Pad the latency out to `targetLatency` whole samples, which must be at
+     * least the filter latency. Call before prepare().
+     */
+    void setTargetLatency(double targetLatency)
+    {
+        jassert(targetLatency >= filterLatency - minFraction);
+        const auto padding = jmax(0.0, targetLatency - filterLatency);
+
+        integerDelay = (size_t)padding;
+        fractionalDelay = padding - (double)integerDelay;
+
+        if (fractionalDelay < minFraction)
+            fractionalDelay = 0.0;
+        else if (fractionalDelay < thiranMinimum && integerDelay > 0)
+        {
+            fractionalDelay += 1.0;
+            --integerDelay;
+        }
+
+        thiranCoeff = (1.0 - fractionalDelay) / (1.0 + fractionalDelay);
+        delayLine.setSize(integerDelay + 1);
+    }
+
+    void prepare(size_t maximumBlockSize)
+    {
+        maxBlockSize = maximumBlockSize;
+        for (size_t n = 0; n < buffers.size(); ++n)
+            buffers[n].setSize(maximumBlockSize << (numStages > 0 ? n + 1 : 0));
+
+        reset();
+    }
+
+    void reset()
+    {
+        for (auto &s : iirStages)
+            s.reset();
+        for (auto &s : firStages)
+            s.reset();
+
+        thiranState = 0.0;
+        delayLine.reset();
+    }
+
+    /* pack and upsample the planar block, returning the oversampled lanes for the amp to run in place */
+    LaneBuffer::Block processSamplesUp(const dsp::AudioBlock<double> &block)
+    {
+        const auto numSamples = jmin(block.getNumSamples(), maxBlockSize);
+
+        if (numStages == 0)
+            return buffers[0].interleave(block);
+
+        if (type == FilterType::polyphaseIIR)
+            upsample(iirStages, block, numSamples, buffers.back().data());
+        else
+            upsample(firStages, block, numSamples, buffers.back().data());
+
+        return {buffers.back().data(), numSamples << numStages};
+    }
+
+    /* downsample the lanes returned by the last processSamplesUp and unpack them into the planar block */
+    void processSamplesDown(dsp::AudioBlock<double> &block)
+    {
+        const auto numSamples = jmin(block.getNumSamples(), maxBlockSize);
+
+        if (numStages == 0)
+        {
+            auto *lanes = buffers[0].data();
+            if (fractionalDelay == 0.0 && integerDelay == 0)
+                buffers[0].deinterleave({lanes, numSamples}, block);
+            else
+                for (size_t i = 0; i < numSamples; ++i)
+                    writeOutput(lanes[i], block, i);
+            return;
+        }
+
+        if (type == FilterType::polyphaseIIR)
+            downsample(iirStages, buffers.back().data(), block, numSamples, buffers);
+        else
+            downsample(firStages, buffers.back().data(), block, numSamples, buffers);
+    }
+
+    /**
+     * Pipelined rendering: the two directions with their own scratch, so the
+     * up path can run on one piece of a block while the down path runs on an
+     * earlier one. Up writes numSamples << numStages lanes to `out`, down
+     * reads as many from `in`. Pieces go through in order and no longer than
+     * `maximumPieceSize`, which must be within the prepared block size; the
+     * result is the same as processing the whole block at once.
+     * prepareSplit() allocates on first use only.
+     */
+    void prepareSplit(size_t maximumPieceSize)
+    {
+        jassert(maximumPieceSize <= maxBlockSize);
+        if (!downBuffers.empty() && downBuffers.back().getSize() >= (maximumPieceSize << numStages))
+            return;
+
+        downBuffers.resize(buffers.size());
+        for (size_t n = 0; n < downBuffers.size(); ++n)
+            downBuffers[n].setSize(maximumPieceSize << (numStages > 0 ? n + 1 : 0));
+    }
+
+    void processSplitUp(const dsp::AudioBlock<double> &block, vec *out)
+    {
+        const auto numSamples = block.getNumSamples();
+
+        if (numStages == 0)
+        {
+            for (size_t i = 0; i < numSamples; ++i)
+                out[i] = LaneBuffer::gather(block, i);
+        }
+        else if (type == FilterType::polyphaseIIR)
+            upsample(iirStages, block, numSamples, out);
+        else
+            upsample(firStages, block, numSamples, out);
+    }
+
+    void processSplitDown(const vec *in, dsp::AudioBlock<double> &block)
+    {
+        const auto numSamples = block.getNumSamples();
+        jassert(!downBuffers.empty() && (numSamples << numStages) <= downBuffers.back().getSize());
+
+        if (numStages == 0)
+        {
+            for (size_t i = 0; i < numSamples; ++i)
+                writeOutput(in[i], block, i);
+        }
+        else if (type == FilterType::polyphaseIIR)
+            downsample(iirStages, in, block, numSamples, downBuffers);
+        else
+            downsample(firStages, in, block, numSamples, downBuffers);
+    }
+
+    /* bytes of filter state, fixed for a given factor, filter type and latency */
+    size_t getStateSize()
+    {
+        size_t size = 0;
+        visitState([&](void *, size_t bytes) { size += bytes; });
+        return size;
+    }
+
+    /* copy every filter's state to or from getStateSize() bytes, for checkpoints */
+    void saveState(void *dest)
+    {
+        auto *d = static_cast<char *>(dest);
+        visitState([&](void *state, size_t bytes) { std::memcpy(d, state, bytes); d += bytes; });
+    }
+
+    void restoreState(const void *src)
+    {
+        auto *s = static_cast<const char *>(src);
+        visitState([&](void *state, size_t bytes) { std::memcpy(state, s, bytes); s += bytes; });
+    }
+
+    /**
+     * Lane `fromLane` of every filter's state in `from`, which must run the
+     * same design, into lane `toLane` here, or zeros into it without `from`.
+     * For batch engines moving a packed stream in or out.
+     */
+    void copyLane(const LaneOversampler *from, size_t fromLane, size_t toLane)
+    {
+        visitLanes(from != nullptr ? *from : *this, *this, [&](const vec &src, vec &dst)
+        {
+            LaneBuffer::setLane(dst, toLane, from != nullptr ? LaneBuffer::getLane(src, fromLane) : 0.0);
+        });
+    }
+
+private:
+    /* pairs up every filter's state in two oversamplers of the same design; histories by age, as their rings can be at different positions */
+    template <typename Visit>
+    static void visitLanes(const LaneOversampler &from, LaneOversampler &to, Visit &&visit)
+    {
+        jassert(from.iirStages.size() == to.iirStages.size() && from.firStages.size() == to.firStages.size());
+
+        auto visitHistory = [&](const History &src, History &dst)
+        {
+            jassert(src.size == dst.size);
+            for (size_t k = 0; k < dst.size; ++k)
+            {
+                const auto j = (dst.pos + k) % dst.size;
+                visit(src.data[src.pos + k], dst.data[j]);
+                dst.data[j + dst.size] = dst.data[j];
+            }
+        };
+
+        for (size_t n = 0; n < to.iirStages.size(); ++n)
+        {
+            auto &src = from.iirStages[n];
+            auto &dst = to.iirStages[n];
+            for (auto chain : {&PolyphaseIIRStage::upDirect, &PolyphaseIIRStage::upDelayed, &PolyphaseIIRStage::downDirect, &PolyphaseIIRStage::downDelayed})
+                for (size_t i = 0; i < (dst.*chain).state.size(); ++i)
+                    visit((src.*chain).state[i], (dst.*chain).state[i]);
+            visit(src.lastDelayed, dst.lastDelayed);
+        }
+
+        for (size_t n = 0; n < to.firStages.size(); ++n)
+            for (auto history : {&EquirippleFIRStage::upHistory, &EquirippleFIRStage::evenHistory, &EquirippleFIRStage::oddHistory})
+                visitHistory(from.firStages[n].*history, to.firStages[n].*history);
+
+        visit(from.thiranState, to.thiranState);
+        visitHistory(from.delayLine, to.delayLine);
+    }
+
+    /* every piece of state as (pointer, bytes), in a fixed order */
+    template <typename Visit>
+    void visitState(Visit &&visit)
+    {
+        auto visitHistory = [&](History &h)
+        {
+            visit(h.data.data(), h.data.size() * sizeof(vec));
+            visit(&h.pos, sizeof(h.pos));
+        };
+
+        for (auto &s : iirStages)
+        {
+            for (auto *chain : {&s.upDirect, &s.upDelayed, &s.downDirect, &s.downDelayed})
+                visit(chain->state.data(), chain->state.size() * sizeof(vec));
+            visit(&s.lastDelayed, sizeof(vec));
+        }
+
+        for (auto &s : firStages)
+            for (auto *h : {&s.upHistory, &s.evenHistory, &s.oddHistory})
+                visitHistory(*h);
+
+        visit(&thiranState, sizeof(vec));
+        visitHistory(delayLine);
+    }
+
+    /* first order allpass sections in series, (a + z^-1) / (1 + a z^-1) each, over shared coefficients */
+    struct AllpassChain
+    {
+        const std::vector<double> *coeffs = nullptr;
+        std::vector<vec> state;
+
+        explicit AllpassChain(const std::vector<double> &c) : coeffs(&c), state(c.size(), vec(0.0)) {}
+
+        inline vec process(vec x)
+        {
+            const auto *a = coeffs->data();
+            for (size_t n = 0; n < state.size(); ++n)
+            {
+                const vec y = a[n] * x + state[n];
+                state[n] = x - a[n] * y;
+                x = y;
+            }
+            return x;
+        }
+
+        void reset() { std::fill(state.begin(), state.end(), vec(0.0)); }
+
+        /* group delay at DC, in samples of the rate the chain runs at */
+        static double getDelay(const std::vector<double> &c)
+        {
+            double d = 0.0;
+            for (auto a : c)
+                d += (1.0 - a) / (1.0 + a);
+            return d;
+        }
+    };
+
+    /**
+     * Halfband as 0.5 * (A0(z^2) + z^-1 A1(z^2)), each branch running at the
+     * low rate, one per output phase when upsampling and one per input phase
+     * when downsampling.
+     */
+    struct PolyphaseIIRStage
+    {
+        struct Design
+        {
+            std::vector<double> direct, delayed;
+
+            Design(double transitionWidth, double stopbandDB)
+            {
+                if (auto *c = findPrecomputedHalfband(transitionWidth, stopbandDB))
+                {
+                    direct.assign(c->direct.begin(), c->direct.begin() + c->numDirect);
+                    delayed.assign(c->delayed.begin(), c->delayed.begin() + c->numDelayed);
+
+#if JUCE_DEBUG
+                    /* the compile-time design should match dsp::FilterDesign to within rounding */
+                    std::vector<double> runtimeDirect, runtimeDelayed;
+                    designAtRuntime(transitionWidth, stopbandDB, runtimeDirect, runtimeDelayed);
+                    jassert(runtimeDirect.size() == direct.size() && runtimeDelayed.size() == delayed.size());
+                    for (size_t i = 0; i < jmin(direct.size(), runtimeDirect.size()); ++i)
+                        jassert(std::abs(direct[i] - runtimeDirect[i]) < 1.0e-12);
+                    for (size_t i = 0; i < jmin(delayed.size(), runtimeDelayed.size()); ++i)
+                        jassert(std::abs(delayed[i] - runtimeDelayed[i]) < 1.0e-12);
+#endif
+                    return;
+                }
+
+                designAtRuntime(transitionWidth, stopbandDB, direct, delayed);
+            }
+
+            static void designAtRuntime(double transitionWidth, double stopbandDB, std::vector<double> &directOut, std::vector<double> &delayedOut)
+            {
+                auto structure = dsp::FilterDesign<double>::designIIRLowpassHalfBandPolyphaseAllpassMethod(transitionWidth, stopbandDB);
+
+                for (int i = 0; i < structure.directPath.size(); ++i)
+                    directOut.push_back(structure.directPath.getObjectPointer(i)->coefficients[0]);
+                /* the first delayed section is the z^-1 itself */
+                for (int i = 1; i < structure.delayedPath.size(); ++i)
+                    delayedOut.push_back(structure.delayedPath.getObjectPointer(i)->coefficients[0]);
+            }
+
+            /* in high rate samples; both branches are unity at DC, so the delays average */
+            double getLatency() const { return AllpassChain::getDelay(direct) + AllpassChain::getDelay(delayed) + 0.5; }
+
+            size_t getMemoryFootprint() const { return sizeof(*this) + (direct.size() + delayed.size()) * sizeof(double); }
+        };
+
+        std::shared_ptr<const Design> up, down;
+        AllpassChain upDirect, upDelayed, downDirect, downDelayed;
+        vec lastDelayed = 0.0;
+
+        PolyphaseIIRStage(DesignCache &designs, double twUp, double dBUp, double twDown, double dBDown)
+            : up(designs.get<Design>(DesignCache::Kind::polyphaseIIR, twUp, dBUp)),
+              down(designs.get<Design>(DesignCache::Kind::polyphaseIIR, twDown, dBDown)),
+              upDirect(up->direct), upDelayed(up->delayed),
+              downDirect(down->direct), downDelayed(down->delayed) {}
+
+        double getLatency() const { return up->getLatency() + down->getLatency(); }
+
+        void reset()
+        {
+            upDirect.reset();
+            upDelayed.reset();
+            downDirect.reset();
+            downDelayed.reset();
+            lastDelayed = 0.0;
+        }
+
+        template <typename Read>
+        inline void processUp(Read read, vec *out, size_t numSamples)
+        {
+            for (size_t i = 0; i < numSamples; ++i)
+            {
+                const auto x = read(i);
+                out[i << 1] = upDirect.process(x);
+                out[(i << 1) + 1] = upDelayed.process(x);
+            }
+        }
+
+        template <typename Write>
+        inline void processDown(const vec *in, Write write, size_t numSamples)
+        {
+            for (size_t i = 0; i < numSamples; ++i)
+            {
+                const auto direct = downDirect.process(in[i << 1]);
+                write(i, (direct + lastDelayed) * 0.5);
+                lastDelayed = downDelayed.process(in[(i << 1) + 1]);
+            }
+        }
+    };
+
+    /* newest-first history, stored twice over so reads never wrap */
+    struct History
+    {
+        std::vector<vec> data;
+        size_t size = 0, pos = 0;
+
+        void setSize(size_t newSize)
+        {
+            size = newSize;
+            data.assign(2 * size, vec(0.0));
+            pos = 0;
+        }
+
+        void reset() { std::fill(data.begin(), data.end(), vec(0.0)); }
+
+        inline void push(vec x)
+        {
+            pos = pos == 0 ? size - 1 : pos - 1;
+            data[pos] = x;
+            data[pos + size] = x;
+        }
+
+        /* [k] is the sample pushed k pushes ago */
+        inline const vec *get() const { return data.data() + pos; }
+    };
+
+    /**
+     * Linear phase halfband split into its two polyphase components. Only the
+     * nonzero taps are kept, which for a halfband leaves one phase a single
+     * scaled delay.
+     */
+    struct EquirippleFIRStage
+    {
+        struct Tap
+        {
+            size_t index;
+            double coeff;
+        };
+
+        struct Design
+        {
+            std::array<std::vector<Tap>, 2> phases;
+            size_t order = 0;
+
+            Design(double transitionWidth, double stopbandDB)
+            {
+                auto fir = dsp::FilterDesign<double>::designFIRLowpassHalfBandEquirippleMethod(transitionWidth, stopbandDB);
+                order = fir->getFilterOrder();
+                const auto *h = fir->getRawCoefficients();
+
+                for (size_t n = 0; n <= order; ++n)
+                    if (h[n] != 0.0)
+                        phases[n & 1].push_back({n >> 1, h[n]});
+            }
+
+            size_t getPhaseLength() const { return order / 2 + 2; }
+
+            size_t getMemoryFootprint() const { return sizeof(*this) + (phases[0].size() + phases[1].size()) * sizeof(Tap); }
+
+            static inline vec convolve(const std::vector<Tap> &taps, const vec *x)
+            {
+                vec y = 0.0;
+                for (const auto &t : taps)
+                    y += t.coeff * x[t.index];
+                return y;
+            }
+        };
+
+        std::shared_ptr<const Design> up, down;
+        History upHistory, evenHistory, oddHistory;
+
+        EquirippleFIRStage(DesignCache &designs, double twUp, double dBUp, double twDown, double dBDown)
+            : up(designs.get<Design>(DesignCache::Kind::equirippleFIR, twUp, dBUp)),
+              down(designs.get<Design>(DesignCache::Kind::equirippleFIR, twDown, dBDown))
+        {
+            upHistory.setSize(up->getPhaseLength());
+            evenHistory.setSize(down->getPhaseLength());
+            oddHistory.setSize(down->getPhaseLength());
+        }
+
+        /* linear phase, order / 2 each way, in high rate samples */
+        double getLatency() const { return 0.5 * (double)(up->order + down->order); }
+
+        void reset()
+        {
+            upHistory.reset();
+            evenHistory.reset();
+            oddHistory.reset();
+        }
+
+        /* zero stuffing halves the level, so the upsampling taps are doubled */
+        template <typename Read>
+        inline void processUp(Read read, vec *out, size_t numSamples)
+        {
+            for (size_t i = 0; i < numSamples; ++i)
+            {
+                upHistory.push(read(i));
+                out[i << 1] = 2.0 * Design::convolve(up->phases[0], upHistory.get());
+                out[(i << 1) + 1] = 2.0 * Design::convolve(up->phases[1], upHistory.get());
+            }
+        }
+
+        /* y[i] = sum h[2k] x[2(i - k)] + sum h[2k + 1] x[2(i - k) - 1] */
+        template <typename Write>
+        inline void processDown(const vec *in, Write write, size_t numSamples)
+        {
+            for (size_t i = 0; i < numSamples; ++i)
+            {
+                evenHistory.push(in[i << 1]);
+                write(i, Design::convolve(down->phases[0], evenHistory.get()) + Design::convolve(down->phases[1], oddHistory.get()));
+                oddHistory.push(in[(i << 1) + 1]);
+            }
+        }
+    };
+
+    /* intermediate stages write to buffers, the last to `out` */
+    template <typename Stages>
+    void upsample(Stages &stages, const dsp::AudioBlock<double> &block, size_t numSamples, vec *out)
+    {
+        stages[0].processUp([&](size_t i) { return LaneBuffer::gather(block, i); }, numStages == 1 ? out : buffers[0].data(), numSamples);
+
+        for (size_t n = 1; n < numStages; ++n)
+        {
+            const auto *in = buffers[n - 1].data();
+            stages[n].processUp([in](size_t i) { return in[i]; }, n == numStages - 1 ? out : buffers[n].data(), numSamples << n);
+        }
+    }
+
+    /* the last stage reads `in`, the others read what the one above left in scratch */
+    template <typename Stages>
+    void downsample(Stages &stages, const vec *in, dsp::AudioBlock<double> &block, size_t numSamples, std::vector<LaneBuffer> &scratch)
+    {
+        for (size_t n = numStages - 1; n > 0; --n)
+        {
+            auto *out = scratch[n - 1].data();
+            stages[n].processDown(n == numStages - 1 ? in : scratch[n].data(), [out](size_t i, vec y) { out[i] = y; }, numSamples << n);
+        }
+
+        const auto *first = numStages == 1 ? in : scratch[0].data();
+        if (fractionalDelay == 0.0 && integerDelay == 0)
+            stages[0].processDown(first, [&](size_t i, vec y) { LaneBuffer::scatter(y, block, i); }, numSamples);
+        else
+            stages[0].processDown(first, [&](size_t i, vec y) { writeOutput(y, block, i); }, numSamples);
+    }
+
+    /* latency padding at the base rate, then back to planar */
+    inline void writeOutput(vec x, dsp::AudioBlock<double> &block, size_t i)
+    {
+        if (fractionalDelay != 0.0)
+        {
+            const vec y = thiranCoeff * x + thiranState;
+            thiranState = x - thiranCoeff * y;
+            x = y;
+        }
+
+        if (integerDelay > 0)
+        {
+            delayLine.push(x);
+            x = delayLine.get()[integerDelay];
+        }
+
+        LaneBuffer::scatter(x, block, i);
+    }
+
+    FilterType type;
+    size_t numStages;
+
+    std::vector<PolyphaseIIRStage> iirStages;
+    std::vector<EquirippleFIRStage> firStages;
+
+    /* buffers[n] holds the output of upsampling stage n; downBuffers the same for the split down path */
+    std::vector<LaneBuffer> buffers, downBuffers;
+    size_t maxBlockSize = 0;
+
+    static constexpr double minFraction = 1.0e-9;
+    /* fractional delays below this are moved up a sample, as in dsp::DelayLine's Thiran interpolation */
+    static constexpr double thiranMinimum = 0.618;
+
+    double filterLatency = 0.0;
+    double fractionalDelay = 0.0, thiranCoeff = 0.0;
+    vec thiranState = 0.0;
+    size_t integerDelay = 0;
+    History delayLine;
+
+    JUCE_DECLARE_NON_COPYABLE(LaneOversampler)
+};
@@ -0,0 +1,152 @@
+// Pipeline.hpp
+
+#pragma once
+
+/**
+ * Runs a block through numStages stage groups as a pipeline: the block is cut
+ * into pieces, the calling thread runs the first group on each piece and a
+ * worker thread per later group takes pieces in order from the one before, so
+ * every group is busy on a different piece at once. Pieces travel in a fixed
+ * set of lane buffers, handed between stages by index through single
+ * producer, single consumer queues; the last stage hands each buffer back to
+ * the first. Each stage sees pieces strictly in order, so stateful stages
+ * give the same result as running the block serially.
+ *
+ * For offline rendering: the stages spin between pieces rather than sleep.
+ */
+class StagePipeline
+{
+public:
+    static constexpr int numStages = 4;
+    /* base rate samples per piece */
+    static constexpr size_t pieceSize = 1024;
+
+    /* run on piece `piece` of the block, held in `lanes` */
+    using Stage = std::function<void(int piece, vec *lanes)>;
+
+    StagePipeline()
+    {
+        for (int s = 1; s < numStages; ++s)
+            workers[(size_t)s - 1] = std::thread([this, s] { run(s); });
+    }
+
+    ~StagePipeline()
+    {
+        quit = true;
+        for (auto &e : start)
+            e.signal();
+        for (auto &w : workers)
+            w.join();
+    }
+
+    /* lanes each piece can carry, which is pieceSize times the oversampling factor; not while processing */
+    void prepare(size_t lanesPerPiece)
+    {
+        for (auto &slot : slots)
+            slot.resize(lanesPerPiece);
+    }
+
+    /* run numPieces pieces through the stages, returning once the last stage is done with the last one */
+    void process(int numPieces, const std::array<Stage, numStages> &stages)
+    {
+        if (numPieces <= 0)
+            return;
+
+        current = &stages;
+        piecesInBlock = numPieces;
+
+        for (int i = 0; i < numSlots; ++i)
+            queues[numStages - 1].push(i);
+
+        for (auto &e : start)
+            e.signal();
+
+        for (int p = 0; p < numPieces; ++p)
+        {
+            const auto slot = queues[numStages - 1].pop();
+            stages[0](p, slots[(size_t)slot].data());
+            queues[0].push(slot);
+        }
+
+        finished.wait();
+
+        /* every buffer is back in the last queue; leave it empty for the next block */
+        for (int i = 0; i < numSlots; ++i)
+            queues[numStages - 1].pop();
+    }
+
+private:
+    static constexpr int numSlots = 8;
+
+    /* buffer indices from one stage to the next; pushes wait for room and pops for an entry */
+    struct SlotQueue
+    {
+        void push(int slot)
+        {
+            int start1, size1, start2, size2;
+            for (;;)
+            {
+                fifo.prepareToWrite(1, start1, size1, start2, size2);
+                if (size1 > 0)
+                    break;
+                std::this_thread::yield();
+            }
+            ring[(size_t)start1] = slot;
+            fifo.finishedWrite(1);
+        }
+
+        int pop()
+        {
+            int start1, size1, start2, size2;
+            for (;;)
+            {
+                fifo.prepareToRead(1, start1, size1, start2, size2);
+                if (size1 > 0)
+                    break;
+                std::this_thread::yield();
+            }
+            const auto slot = ring[(size_t)start1];
+            fifo.finishedRead(1);
+            return slot;
+        }
+
+        /* a fifo of n holds n - 1 */
+        AbstractFifo fifo{numSlots + 1};
+        std::array<int, numSlots + 1> ring{};
+    };
+
+    /* worker for stage s: takes pieces from queue s - 1 and passes them to queue s */
+    void run(int s)
+    {
+        for (;;)
+        {
+            start[(size_t)s - 1].wait();
+            if (quit)
+                return;
+
+            const auto &stage = (*current)[(size_t)s];
+            for (int p = 0; p < piecesInBlock; ++p)
+            {
+                const auto slot = queues[(size_t)s - 1].pop();
+                stage(p, slots[(size_t)slot].data());
+                queues[(size_t)s].push(slot);
+            }
+
+            if (s == numStages - 1)
+                finished.signal();
+        }
+    }
+
+    std::array<std::vector<vec, xsimd::aligned_allocator<vec>>, numSlots> slots;
+    std::array<SlotQueue, numStages> queues;
+
+    const std::array<Stage, numStages> *current = nullptr;
+    int piecesInBlock = 0;
+
+    std::array<WaitableEvent, numStages - 1> start;
+    WaitableEvent finished;
+    std::atomic<bool> quit{false};
+    std::array<std::thread, numStages - 1> workers;
+
+    JUCE_DECLARE_NON_COPYABLE(StagePipeline)
+};
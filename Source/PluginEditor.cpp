@@ -11,7 +11,11 @@
 
 //==============================================================================
 STRXAudioProcessorEditor::STRXAudioProcessorEditor (STRXAudioProcessor& p)
-    : AudioProcessorEditor (&p), customLookAndFeel(p.apvts), background(p.apvts), amp(p.apvts, &customLookAndFeel), audioProcessor(p)
+    : AudioProcessorEditor (&p), customLookAndFeel(p.apvts), background(p.apvts), amp(p.apvts, &customLookAndFeel), cpuMeter(p.getProfiler()),
+#if JUCE_DEBUG
+      deadlineOverlay(p),
+#endif
+      audioProcessor(p)
 {
     tooltipWindow.setMillisecondsBeforeTipAppears(1000);
 
@@ -24,6 +28,12 @@ STRXAudioProcessorEditor::STRXAudioProcessorEditor (STRXAudioProcessor& p)
 
     addAndMakeVisible(amp);
 
+    addAndMakeVisible(cpuMeter);
+
+#if JUCE_DEBUG
+    addAndMakeVisible(deadlineOverlay);
+#endif
+
 	bool chan = (bool)*channel;
 
     addAndMakeVisible(outVol);
@@ -43,6 +53,20 @@ STRXAudioProcessorEditor::STRXAudioProcessorEditor (STRXAudioProcessor& p)
     hqButton.setLookAndFeel(&customLookAndFeel);
     addAndMakeVisible(hqButton);
     hqButton.setTooltip("Enables 4x oversampling with minimal latency");
+
+    autoHQButton.setButtonText("Auto");
+    autoHQButton.setClickingTogglesState(true);
+    autoHQButton.setRepaintsOnMouseActivity(true);
+    autoHQButton.setLookAndFeel(&customLookAndFeel);
+    addAndMakeVisible(autoHQButton);
+    autoHQButton.setTooltip("Switches between 1x, 2x and 4x oversampling to suit how hard the amp is driven, at the latency of HQ");
+
+    fixedRateButton.setButtonText("Fixed");
+    fixedRateButton.setClickingTogglesState(true);
+    fixedRateButton.setRepaintsOnMouseActivity(true);
+    fixedRateButton.setLookAndFeel(&customLookAndFeel);
+    addAndMakeVisible(fixedRateButton);
+    fixedRateButton.setTooltip("Runs the amp at 176.4 kHz for 22.05, 44.1 and 88.2 kHz sessions and 192 kHz for 24, 48 and 96 kHz ones, so it sounds and costs the same across them. Other rates run at the highest doubling under 192 kHz, e.g. 128 kHz for 32 and 64 kHz");
     
     renderHQ.setButtonText("HQ Rendering");
     renderHQ.setClickingTogglesState(true);
@@ -51,6 +75,32 @@ STRXAudioProcessorEditor::STRXAudioProcessorEditor (STRXAudioProcessor& p)
     addAndMakeVisible(renderHQ);
     renderHQ.setTooltip("Enables 4x oversampling during rendering, using higher quality filters with fully linear phase");
 
+    addAndMakeVisible(gate);
+    gate.setSliderStyle(Slider::LinearHorizontal);
+    gate.setTextBoxStyle(Slider::TextBoxLeft, false, 60, 20);
+    gate.setColour(Slider::backgroundColourId, Colour(GRAY));
+    gate.setColour(Slider::thumbColourId, Colours::white);
+    gate.setColour(Slider::trackColourId, Colour(LIGHT_ACCENT));
+    gate.setColour(Slider::textBoxOutlineColourId, Colours::transparentBlack);
+    gate.setTextValueSuffix(" dB");
+    gate.setTooltip("Input noise gate threshold. Fully left turns the gate off");
+    gateAttach = std::make_unique<AudioProcessorValueTreeState::SliderAttachment>(p.apvts, "gate", gate);
+
+    cabButton.setButtonText("Cab");
+    cabButton.setClickingTogglesState(true);
+    cabButton.setRepaintsOnMouseActivity(true);
+    cabButton.setLookAndFeel(&customLookAndFeel);
+    addAndMakeVisible(cabButton);
+    cabButton.setTooltip("Enables the built-in cabinet convolution, with no added latency");
+    cabAttach = std::make_unique<AudioProcessorValueTreeState::ButtonAttachment>(p.apvts, "cab", cabButton);
+
+    irButton.setButtonText("IR...");
+    irButton.setRepaintsOnMouseActivity(true);
+    irButton.setLookAndFeel(&customLookAndFeel);
+    addAndMakeVisible(irButton);
+    irButton.setTooltip("Load a cabinet impulse response, or return to the built-in one");
+    irButton.onClick = [&] { showIRMenu(); };
+
     addAndMakeVisible(stereo);
     stereo.lnf = &customLookAndFeel;
     stereoAttach = std::make_unique<AudioProcessorValueTreeState::ButtonAttachment>(p.apvts, "stereo", stereo);
@@ -62,6 +112,29 @@ STRXAudioProcessorEditor::STRXAudioProcessorEditor (STRXAudioProcessor& p)
 
     outVolAttachment = std::make_unique<AudioProcessorValueTreeState::SliderAttachment>(p.apvts, "outVol", outVol);
     hqButtonAttach = std::make_unique<AudioProcessorValueTreeState::ButtonAttachment>(p.apvts, "hq", hqButton);
+    autoHQAttach = std::make_unique<AudioProcessorValueTreeState::ButtonAttachment>(p.apvts, "autoHQ", autoHQButton);
+    fixedRateAttach = std::make_unique<AudioProcessorValueTreeState::ButtonAttachment>(p.apvts, "fixedRate", fixedRateButton);
+
+    /* HQ, Auto and Fixed each choose the realtime quality outright, so switching one on switches the others off */
+    static const char *const qualityIDs[] = {"hq", "autoHQ", "fixedRate"};
+    const std::array<TextButton *, 3> qualityButtons{&hqButton, &autoHQButton, &fixedRateButton};
+    for (size_t i = 0; i < qualityButtons.size(); ++i)
+        qualityButtons[i]->onClick = [this, i, button = qualityButtons[i]]
+        {
+            if (!button->getToggleState())
+                return;
+
+            for (size_t other = 0; other < std::size(qualityIDs); ++other)
+            {
+                auto *param = audioProcessor.apvts.getParameter(qualityIDs[other]);
+                if (other == i || param->getValue() < 0.5f)
+                    continue;
+
+                param->beginChangeGesture();
+                param->setValueNotifyingHost(0.f);
+                param->endChangeGesture();
+            }
+        };
     renderButtonAttach = std::make_unique<AudioProcessorValueTreeState::ButtonAttachment>(p.apvts, "renderHQ", renderHQ);
     legacyToneAttach = std::make_unique<AudioProcessorValueTreeState::ButtonAttachment>(p.apvts, "legacyTone", legacyTone);
 
@@ -75,7 +148,29 @@ STRXAudioProcessorEditor::~STRXAudioProcessorEditor()
 {
     audioProcessor.apvts.removeParameterListener("channel", this);
     hqButton.setLookAndFeel(nullptr);
+    autoHQButton.setLookAndFeel(nullptr);
+    fixedRateButton.setLookAndFeel(nullptr);
     renderHQ.setLookAndFeel(nullptr);
+    cabButton.setLookAndFeel(nullptr);
+    irButton.setLookAndFeel(nullptr);
+}
+
+void STRXAudioProcessorEditor::showIRMenu()
+{
+    PopupMenu menu;
+    menu.addItem("Load Impulse Response...", [&]
+    {
+        irChooser = std::make_unique<FileChooser>("Load Impulse Response", File(), "*.wav;*.aif;*.aiff");
+        irChooser->launchAsync(FileBrowserComponent::openMode | FileBrowserComponent::canSelectFiles,
+                               [&](const FileChooser &fc)
+                               {
+                                   auto file = fc.getResult();
+                                   if (file.existsAsFile())
+                                       audioProcessor.loadCabinetIR(file);
+                               });
+    });
+    menu.addItem("Use Built-in Cabinet", [&] { audioProcessor.clearCabinetIR(); });
+    menu.showMenuAsync(PopupMenu::Options().withTargetComponent(&irButton));
 }
 
 //==============================================================================
@@ -91,17 +186,30 @@ void STRXAudioProcessorEditor::resized()
 {
     auto bounds = getLocalBounds().reduced(10);
     const auto w = bounds.getWidth();
+
+    /* per-stage load, in the bottom margin */
+    cpuMeter.setBounds(getLocalBounds().removeFromBottom(10).withTrimmedLeft(10).withTrimmedRight(10));
     const auto h = bounds.getHeight();
 
     background.setBounds(bounds.removeFromTop(h / 3));
 
     amp.setBounds(bounds.removeFromTop(bounds.getHeight() * 0.85f));
 
+#if JUCE_DEBUG
+    /* across the top edge of the amp; click to reset */
+    deadlineOverlay.setBounds(amp.getBounds().removeFromTop(14).withTrimmedLeft(w / 4).withTrimmedRight(w / 4));
+#endif
+
     outVol.setBounds(background.getBounds().withTrimmedLeft(w * 0.9f).reduced(5));
 
-    hqButton.setBounds(bounds.removeFromLeft(w * 0.1f));
-    renderHQ.setBounds(bounds.removeFromLeft(w * 0.15f));
-    stereo.setBounds(bounds.removeFromLeft(w * 0.15f));
+    hqButton.setBounds(bounds.removeFromLeft(w * 0.08f));
+    autoHQButton.setBounds(bounds.removeFromLeft(w * 0.08f));
+    fixedRateButton.setBounds(bounds.removeFromLeft(w * 0.08f));
+    renderHQ.setBounds(bounds.removeFromLeft(w * 0.14f));
+    stereo.setBounds(bounds.removeFromLeft(w * 0.12f));
+    cabButton.setBounds(bounds.removeFromLeft(w * 0.08f));
+    irButton.setBounds(bounds.removeFromLeft(w * 0.08f));
+    gate.setBounds(bounds.removeFromLeft(w * 0.14f).reduced(5));
     legacyTone.setBounds(bounds.removeFromRight(w * 0.2f));
 
     audioProcessor.lastUIWidth = getWidth();
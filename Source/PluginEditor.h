@@ -24,6 +24,8 @@ static Typeface::Ptr getCustomFont()
 #include "Background.hpp"
 #include "LookAndFeel.h"
 #include "AmpComponent.hpp"
+#include "CPUMeter.hpp"
+#include "DeadlineOverlay.hpp"
 
 struct StereoButton : TextButton
 {
@@ -92,9 +94,17 @@ private:
     Slider outVol;
     std::unique_ptr<AudioProcessorValueTreeState::SliderAttachment> outVolAttachment;
 
-    TextButton hqButton, renderHQ;
+    TextButton hqButton, autoHQButton, fixedRateButton, renderHQ;
     StereoButton stereo;
-    std::unique_ptr<AudioProcessorValueTreeState::ButtonAttachment> hqButtonAttach, renderButtonAttach, stereoAttach;
+    std::unique_ptr<AudioProcessorValueTreeState::ButtonAttachment> hqButtonAttach, autoHQAttach, fixedRateAttach, renderButtonAttach, stereoAttach;
+
+    Slider gate;
+    std::unique_ptr<AudioProcessorValueTreeState::SliderAttachment> gateAttach;
+
+    TextButton cabButton, irButton;
+    std::unique_ptr<AudioProcessorValueTreeState::ButtonAttachment> cabAttach;
+    std::unique_ptr<FileChooser> irChooser;
+    void showIRMenu();
 
     ToggleButton legacyTone;
     std::unique_ptr<AudioProcessorValueTreeState::ButtonAttachment> legacyToneAttach;
@@ -104,6 +114,12 @@ private:
 
     AmpComponent amp;
 
+    CPUMeter cpuMeter;
+
+#if JUCE_DEBUG
+    DeadlineOverlay deadlineOverlay;
+#endif
+
     TooltipWindow tooltipWindow;
 
     std::unique_ptr<Drawable> logo;
@@ -7,7 +7,64 @@
 */
 
 #include "PluginProcessor.h"
+#if !STRX_HEADLESS
 #include "PluginEditor.h"
+#endif
+
+/**
+ * Binary session state: this header, then { id hash, value } for every
+ * parameter, then the cabinet IR path as UTF-8. Values are stored
+ * denormalised, so they survive range changes between versions.
+ */
+struct BinaryStateHeader
+{
+    uint32 magic, version;
+    int32 uiWidth, uiHeight;
+    uint64 cabIRHash;
+    uint32 numParameters, pathSize;
+};
+
+struct BinaryStateParameter
+{
+    uint32 id;
+    float value;
+};
+
+static constexpr uint32 binaryStateMagic = 0x42585453; // "STXB"
+static constexpr uint32 binaryStateVersion = 1;
+
+/* followed by an AmpProcessor checkpoint and the oversampler state of each engine the quality runs */
+struct CheckpointHeader
+{
+    uint32 magic, version;
+    double sampleRate;
+    int32 osIndex, numEngines;
+    uint64 engineBytes;
+    DriveEstimator estimator;
+    int32 autoLevel, fadeFromLevel, transitionPos;
+    float lastOutGain;
+    bool chainSettled;
+    NoiseGate::Checkpoint gate;
+};
+
+static constexpr uint32 checkpointMagic = 0x43585453; // "STXC"
+static constexpr uint32 checkpointVersion = 1;
+
+static_assert(std::is_trivially_copyable<CheckpointHeader>::value && std::is_trivially_copyable<AmpProcessor<vec>::Checkpoint>::value,
+              "checkpoints are stored as raw bytes");
+
+/* 32-bit FNV-1a of the parameter ID */
+static uint32 hashParameterID(const String &id)
+{
+    uint32 h = 2166136261u;
+    for (auto *c = id.toRawUTF8(); *c != 0; ++c)
+    {
+        h ^= (uint8)*c;
+        h *= 16777619u;
+    }
+
+    return h;
+}
 
 //==============================================================================
 STRXAudioProcessor::STRXAudioProcessor()
@@ -21,32 +78,54 @@ STRXAudioProcessor::STRXAudioProcessor()
 #endif
                          ),
       apvts(*this, nullptr, "Parameters", createParameters()),
-      stereoAmp(apvts), monoAmp(apvts)
+      amp(apvts)
 
 #endif
 {
-    oversample.emplace_back(std::make_unique<dsp::Oversampling<double>>(2));
-    oversample.emplace_back(std::make_unique<dsp::Oversampling<double>>(2, 2, dsp::Oversampling<double>::FilterType::filterHalfBandPolyphaseIIR, false, true));
-    oversample.emplace_back(std::make_unique<dsp::Oversampling<double>>(2, 2, dsp::Oversampling<double>::FilterType::filterHalfBandFIREquiripple, true, true));
-
     lastUIWidth = 775;
     lastUIHeight = 500;
     hq = static_cast<strix::BoolParameter*>(apvts.getParameter("hq"));
     renderHQ = static_cast<strix::BoolParameter*>(apvts.getParameter("renderHQ"));
+    autoHQ = static_cast<strix::BoolParameter*>(apvts.getParameter("autoHQ"));
+    fixedRate = static_cast<strix::BoolParameter*>(apvts.getParameter("fixedRate"));
+    bypass = static_cast<strix::BoolParameter*>(apvts.getParameter("bypass"));
+    cab = static_cast<strix::BoolParameter*>(apvts.getParameter("cab"));
     stereo = static_cast<strix::ChoiceParameter*>(apvts.getParameter("stereo"));
     outVol_dB = static_cast<strix::FloatParameter*>(apvts.getParameter("outVol"));
+    gateThresh = static_cast<strix::FloatParameter*>(apvts.getParameter("gate"));
+    ampGain = apvts.getRawParameterValue("gain");
+    ampMaster = apvts.getRawParameterValue("master");
+    ampTSX = apvts.getRawParameterValue("tsXgain");
+    ampChannel = apvts.getRawParameterValue("channel");
     apvts.addParameterListener("mode", this);
     apvts.addParameterListener("legacyTone", this);
     apvts.addParameterListener("hq", this);
     apvts.addParameterListener("renderHQ", this);
+    apvts.addParameterListener("autoHQ", this);
+    apvts.addParameterListener("fixedRate", this);
+    apvts.addParameterListener("cab", this);
+    apvts.addParameterListener("stereo", this);
+
+    for (auto *p : getParameters())
+        if (auto *param = dynamic_cast<RangedAudioParameter*>(p))
+            stateParameters.emplace_back(hashParameterID(param->getParameterID()), param);
+
+    amp.setProfiler(&profiler);
+
+    constructMs = Time::getMillisecondCounterHiRes() - constructionStart;
 }
 
 STRXAudioProcessor::~STRXAudioProcessor()
 {
+    stopBackgroundBuild();
     apvts.removeParameterListener("hq", this);
     apvts.removeParameterListener("renderHQ", this);
+    apvts.removeParameterListener("autoHQ", this);
+    apvts.removeParameterListener("fixedRate", this);
     apvts.removeParameterListener("mode", this);
     apvts.removeParameterListener("legacyTone", this);
+    apvts.removeParameterListener("cab", this);
+    apvts.removeParameterListener("stereo", this);
 }
 
 //==============================================================================
@@ -114,71 +193,258 @@ void STRXAudioProcessor::changeProgramName(int index, const String &newName)
 //==============================================================================
 void STRXAudioProcessor::prepareToPlay(double sampleRate, int samplesPerBlock)
 {
+    const auto start = Time::getMillisecondCounterHiRes();
+
+    stopBackgroundBuild();
+
     lastDownSampleRate = sampleRate;
     numSamples = samplesPerBlock;
 
+    /* block size may have changed, so every oversampler needs initialising again */
+    for (auto &ready : oversampleReady)
+        ready = false;
+
     updateOversample();
+    buildQuality(osIndex);
+    pendingOversample = false;
 
     dsp::ProcessSpec spec;
-    spec.maximumBlockSize = samplesPerBlock * (isOversampled ? 4.0 : 1.0);
+    spec.maximumBlockSize = samplesPerBlock * oversampleFactor;
     spec.sampleRate = lastSampleRate;
     spec.numChannels = getTotalNumInputChannels();
 
-    for (auto &ovs : oversample)
-        ovs->initProcessing(samplesPerBlock);
-
-    stereoAmp.prepare(spec);
-    monoAmp.prepare(spec);
-    stereoAmp.preAmp.updateCrossover(*apvts.getRawParameterValue("mode"));
-    monoAmp.preAmp.updateCrossover(*apvts.getRawParameterValue("mode"));
+    prepareAmp();
 
     doubleBuffer.setSize(spec.numChannels, spec.maximumBlockSize);
+    warmUpBuffer.setSize(spec.numChannels, samplesPerBlock);
+    fadeBuffer.setSize(spec.numChannels, samplesPerBlock);
+
+    driveEstimator.prepare(sampleRate);
+    preRollSamples = (int)(0.02 * sampleRate);
+    fadeSamples = jmax(1, (int)(0.02 * sampleRate));
+    resetAmpChain();
+
+    gate.setThreshold(*gateThresh);
+    gate.prepare({sampleRate, (uint32)samplesPerBlock, spec.numChannels});
+    chainSettled = false;
+
+    softBypass.prepare({sampleRate, (uint32)samplesPerBlock, spec.numChannels});
+    softBypass.setBypassed(*bypass);
+    softBypass.setLatency((int)oversample[osIndex]->getLatencyInSamples());
+
+    cabinet.prepare({sampleRate, (uint32)samplesPerBlock, spec.numChannels}, getCabinetResponse());
+
+    startBackgroundBuild();
 
-    simd.setInterleavedBlockSize(spec.numChannels, spec.maximumBlockSize);
+    prepareMs = Time::getMillisecondCounterHiRes() - start;
 }
 
 void STRXAudioProcessor::releaseResources()
 {
-    for (auto &oversampler : oversample)
-        oversampler->reset();
+    stopBackgroundBuild();
+    reset();
+}
+
+void STRXAudioProcessor::reset()
+{
+    for (int i = 0; i < numOversamplers; ++i)
+        if (oversampleReady[i])
+            oversample[i]->reset();
 
-    stereoAmp.reset();
-    monoAmp.reset();
+    resetAmpChain();
+    softBypass.reset();
+    gate.reset();
+    chainSettled = false;
+    cabinet.reset();
 }
 
 #ifndef JucePlugin_PreferredChannelConfigurations
 bool STRXAudioProcessor::isBusesLayoutSupported(const BusesLayout &layouts) const
 {
-    if (layouts.getMainOutputChannelSet() != AudioChannelSet::mono() && layouts.getMainOutputChannelSet() != AudioChannelSet::stereo())
-        return false;
+    const auto in = layouts.getMainInputChannelSet();
+    const auto out = layouts.getMainOutputChannelSet();
 
-    if (layouts.getMainOutputChannelSet() != layouts.getMainInputChannelSet())
+    if (out != AudioChannelSet::mono() && out != AudioChannelSet::stereo())
         return false;
 
-    return true;
+    /* mono in, stereo out runs one channel and copies it to both outputs */
+    return in == out || (in == AudioChannelSet::mono() && out == AudioChannelSet::stereo());
 }
 #endif
 
-void STRXAudioProcessor::updateOversample()
+/* the editor keeps HQ, Auto and Fixed exclusive; if automation switches on more than one, the first here wins */
+int STRXAudioProcessor::getOversampleIndex() const
 {
     if (*renderHQ && isNonRealtime())
+        return 2;
+    if (*autoHQ)
+        return autoOversampler;
+    if (*fixedRate)
+        return fixedRateOversampler;
+    if (*hq)
+        return 1;
+
+    return 0;
+}
+
+Range<int> STRXAudioProcessor::getQualityOversamplers(int index)
+{
+    if (index == autoOversampler)
+        return {autoOversampler, autoOversampler + DriveEstimator::numLevels};
+
+    return {index, index + 1};
+}
+
+bool STRXAudioProcessor::isQualityReady(int index) const
+{
+    const auto range = getQualityOversamplers(index);
+    for (int i = range.getStart(); i < range.getEnd(); ++i)
+        if (!oversampleReady[i])
+            return false;
+
+    return true;
+}
+
+void STRXAudioProcessor::buildQuality(int index)
+{
+    const auto range = getQualityOversamplers(index);
+    for (int i = range.getStart(); i < range.getEnd(); ++i)
+        if (!oversampleReady[i])
+            buildOversampler(i);
+}
+
+size_t STRXAudioProcessor::getFixedRateStages(double sampleRate)
+{
+    /* doubling only ever moves towards the target until it passes it, so take the most doublings that stay at or under it */
+    size_t stages = 0;
+    while (stages < maxFixedRateStages && sampleRate * (double)(2 << stages) <= maxFixedRate + 1.0)
+        ++stages;
+
+    return stages;
+}
+
+void STRXAudioProcessor::updateOversample()
+{
+    osIndex = getOversampleIndex();
+
+    if (osIndex == 1 || osIndex == 2)
+        oversampleFactor = 4;
+    else if (osIndex == fixedRateOversampler)
+        oversampleFactor = 1 << getFixedRateStages(lastDownSampleRate);
+    else
+        oversampleFactor = 1;
+
+    lastSampleRate = oversampleFactor * lastDownSampleRate;
+}
+
+std::unique_ptr<LaneOversampler> STRXAudioProcessor::createOversampler(int index)
+{
+    using Filter = LaneOversampler::FilterType;
+
+    switch (index)
     {
-        osIndex = 2;
-        lastSampleRate = 4.0 * lastDownSampleRate;
-        isOversampled = true;
-    }
-    else if (*hq)
+    case 1:
+        return std::make_unique<LaneOversampler>(designCache.get(), 2, Filter::polyphaseIIR, false);
+    case 2:
+        return std::make_unique<LaneOversampler>(designCache.get(), 2, Filter::equirippleFIR, true);
+    case autoOversampler:
+    case autoOversampler + 1:
+    case autoOversampler + 2:
     {
-        osIndex = 1;
-        lastSampleRate = 4.0 * lastDownSampleRate;
-        isOversampled = true;
+        /* every auto level reports the latency of the 4x one, so switching never moves the output */
+        auto os = std::make_unique<LaneOversampler>(designCache.get(), (size_t)(index - autoOversampler), Filter::polyphaseIIR, false);
+        os->setTargetLatency(LaneOversampler(designCache.get(), 2, Filter::polyphaseIIR, false).getLatencyInSamples());
+        return os;
     }
-    else
+    case fixedRateOversampler:
+        return std::make_unique<LaneOversampler>(designCache.get(), getFixedRateStages(lastDownSampleRate), Filter::polyphaseIIR, false);
+    default:
+        return std::make_unique<LaneOversampler>(designCache.get(), 0, Filter::polyphaseIIR, false);
+    }
+}
+
+void STRXAudioProcessor::buildOversampler(int index)
+{
+    /* the fixed rate one's factor depends on the host rate, so it may need rebuilding */
+    if (oversample[index] == nullptr
+        || (index == fixedRateOversampler && oversample[index]->getOversamplingFactor() != ((size_t)1 << getFixedRateStages(lastDownSampleRate))))
+        oversample[index] = createOversampler(index);
+
+    const auto autoLevels = getQualityOversamplers(autoOversampler);
+    if (autoLevels.contains(index) && autoAmps[(size_t)(index - autoOversampler)] == nullptr)
     {
-        osIndex = 0;
-        lastSampleRate = lastDownSampleRate;
-        isOversampled = false;
+        auto &engine = autoAmps[(size_t)(index - autoOversampler)];
+        engine = std::make_unique<AmpProcessor<vec>>(apvts);
+        engine->setProfiler(&profiler);
     }
+
+    const auto ampRate = lastDownSampleRate * (double)oversample[index]->getOversamplingFactor();
+    if (ampDesigns[index] == nullptr || ampDesigns[index]->sampleRate != ampRate)
+        ampDesigns[index] = designCache->get<AmpDesign>(DesignCache::Kind::ampFilters, ampRate);
+
+    oversample[index]->prepare((size_t)numSamples);
+    oversampleReady[index] = true;
+}
+
+void STRXAudioProcessor::startBackgroundBuild()
+{
+    if (buildOnDemand)
+        return;
+
+    cancelBuild = false;
+    engineBuilder = std::thread([this]
+    {
+        const auto start = Time::getMillisecondCounterHiRes();
+
+        for (bool first = true; !cancelBuild; first = false)
+        {
+            for (int i = 0; i < numOversamplers && !cancelBuild; ++i)
+                if (!oversampleReady[i] && isBuildWanted(i))
+                    buildOversampler(i);
+
+            if (first)
+                backgroundBuildMs = Time::getMillisecondCounterHiRes() - start;
+
+            buildRequest.wait();
+        }
+    });
+}
+
+void STRXAudioProcessor::stopBackgroundBuild()
+{
+    cancelBuild = true;
+    buildRequest.signal();
+    if (engineBuilder.joinable())
+        engineBuilder.join();
+}
+
+void STRXAudioProcessor::prepareAmp()
+{
+    ampSpec.sampleRate = lastSampleRate;
+    ampSpec.maximumBlockSize = numSamples * oversampleFactor;
+    ampSpec.numChannels = getTotalNumInputChannels();
+
+    /* the main amp sits idle under auto quality, so it waits for the next switch away */
+    if (!isAutoQuality())
+        amp.prepare(ampSpec, *ampDesigns[osIndex]);
+    else
+        for (int level = 0; level < DriveEstimator::numLevels; ++level)
+            autoAmps[(size_t)level]->prepare({lastDownSampleRate * (1 << level), (uint32)(numSamples << level), ampSpec.numChannels},
+                                             *ampDesigns[autoOversampler + level]);
+}
+
+void STRXAudioProcessor::resetAmpChain()
+{
+    const auto range = getQualityOversamplers(osIndex);
+    for (int i = range.getStart(); i < range.getEnd(); ++i)
+        if (oversampleReady[i])
+            oversample[i]->reset();
+
+    forEachAmp([](auto &a) { a.reset(); });
+
+    driveEstimator.reset();
+    autoLevel = driveEstimator.getLevel();
+    fadeFromLevel = -1;
 }
 
 void STRXAudioProcessor::parameterChanged(const String &parameterID, float)
@@ -218,58 +484,670 @@ void STRXAudioProcessor::processBlock(AudioBuffer<double> &buffer, MidiBuffer &)
     processDoubleBuffer(buffer);
 }
 
-void STRXAudioProcessor::processDoubleBuffer(AudioBuffer<double> &buffer)
+void STRXAudioProcessor::processBlockBypassed(AudioBuffer<float> &buffer, MidiBuffer &)
 {
-    if (newMessages)
+    ScopedNoDenormals noDenormals;
+    auto totalNumInputChannels = getTotalNumInputChannels();
+    auto totalNumOutputChannels = getTotalNumOutputChannels();
+
+    for (auto i = totalNumInputChannels; i < totalNumOutputChannels; ++i)
+        buffer.clear(i, 0, buffer.getNumSamples());
+
+    doubleBuffer.makeCopyOf(buffer, true);
+
+    processDoubleBuffer(doubleBuffer, true);
+
+    buffer.makeCopyOf(doubleBuffer, true);
+}
+
+void STRXAudioProcessor::processBlockBypassed(AudioBuffer<double> &buffer, MidiBuffer &)
+{
+    ScopedNoDenormals noDenormals;
+    auto totalNumInputChannels = getTotalNumInputChannels();
+    auto totalNumOutputChannels = getTotalNumOutputChannels();
+
+    for (auto i = totalNumInputChannels; i < totalNumOutputChannels; ++i)
+        buffer.clear(i, 0, buffer.getNumSamples());
+
+    processDoubleBuffer(buffer, true);
+}
+
+void STRXAudioProcessor::processAmpStage(dsp::AudioBlock<double> &block)
+{
+    if (isAutoQuality())
+        processAutoChain(block);
+    else if (pipeline != nullptr && isNonRealtime() && block.getNumSamples() > StagePipeline::pieceSize)
+        processPipelined(block);
+    else
+    {
+        auto laneBlock = [&]
+        {
+            const StageProfiler::Scope scope(&profiler, StageProfiler::upsample);
+            return oversample[osIndex]->processSamplesUp(block);
+        }();
+
+        amp.processAmp(laneBlock);
+
+        const StageProfiler::Scope scope(&profiler, StageProfiler::downsample);
+        oversample[osIndex]->processSamplesDown(block);
+    }
+}
+
+void STRXAudioProcessor::setPipelinedRendering(bool shouldPipeline)
+{
+    if (!shouldPipeline)
+        pipeline.reset();
+    else if (pipeline == nullptr)
+        pipeline = std::make_unique<StagePipeline>();
+}
+
+void STRXAudioProcessor::processPipelined(dsp::AudioBlock<double> &block)
+{
+    auto &os = *oversample[osIndex];
+    constexpr auto pieceSize = StagePipeline::pieceSize;
+
+    /* offline only, so allocating on first use is fine */
+    os.prepareSplit(pieceSize);
+    pipeline->prepare(pieceSize * os.getOversamplingFactor());
+
+    const auto numSamples = block.getNumSamples();
+    const auto numPieces = (int)((numSamples + pieceSize - 1) / pieceSize);
+    auto getPiece = [&](int p) { return block.getSubBlock((size_t)p * pieceSize, jmin(pieceSize, numSamples - (size_t)p * pieceSize)); };
+    auto getLanes = [&](int p, vec *lanes) { return LaneBuffer::Block{lanes, getPiece(p).getNumSamples() * os.getOversamplingFactor()}; };
+
+    const auto setup = amp.prepareStages();
+
+    pipeline->process(numPieces, {{[&](int p, vec *lanes) { os.processSplitUp(getPiece(p), lanes); },
+                                   [&](int p, vec *lanes)
+                                   {
+                                       auto lanesBlock = getLanes(p, lanes);
+                                       amp.processPreStages(lanesBlock, setup);
+                                   },
+                                   [&](int p, vec *lanes)
+                                   {
+                                       auto lanesBlock = getLanes(p, lanes);
+                                       amp.processPostStages(lanesBlock, setup);
+                                   },
+                                   [&](int p, vec *lanes)
+                                   {
+                                       auto piece = getPiece(p);
+                                       os.processSplitDown(lanes, piece);
+                                   }}});
+}
+
+void STRXAudioProcessor::processAmpChain(dsp::AudioBlock<double> &block)
+{
+    processAmpStage(block);
+
+    if (*cab)
+        cabinet.process(block);
+}
+
+AmpProcessor<vec> &STRXAudioProcessor::getEngineAmp(int oversamplerIndex)
+{
+    return getQualityOversamplers(autoOversampler).contains(oversamplerIndex) ? *autoAmps[(size_t)(oversamplerIndex - autoOversampler)] : amp;
+}
+
+MemoryBlock STRXAudioProcessor::saveCheckpoint()
+{
+    if (!isQualityReady(osIndex))
+        return {};
+
+    const auto range = getQualityOversamplers(osIndex);
+
+    /* zeroed and filled field by field, so padding doesn't make equal checkpoints hash differently */
+    CheckpointHeader header;
+    std::memset((void *)&header, 0, sizeof(header));
+    header.magic = checkpointMagic;
+    header.version = checkpointVersion;
+    header.sampleRate = lastDownSampleRate;
+    header.osIndex = osIndex;
+    header.numEngines = range.getLength();
+    header.estimator = driveEstimator;
+    header.autoLevel = autoLevel;
+    header.fadeFromLevel = fadeFromLevel;
+    header.transitionPos = transitionPos;
+    header.lastOutGain = lastOutGain;
+    header.chainSettled = chainSettled;
+    gate.saveCheckpoint(header.gate);
+
+    for (int i = range.getStart(); i < range.getEnd(); ++i)
+        header.engineBytes += sizeof(AmpProcessor<vec>::Checkpoint) + oversample[i]->getStateSize();
+
+    MemoryBlock block((size_t)(sizeof(header) + header.engineBytes));
+    auto *dest = static_cast<char *>(block.getData());
+    std::memcpy(dest, &header, sizeof(header));
+    dest += sizeof(header);
+
+    for (int i = range.getStart(); i < range.getEnd(); ++i)
+    {
+        AmpProcessor<vec>::Checkpoint ampCheckpoint;
+        std::memset((void *)&ampCheckpoint, 0, sizeof(ampCheckpoint));
+        getEngineAmp(i).saveCheckpoint(ampCheckpoint);
+        std::memcpy(dest, &ampCheckpoint, sizeof(ampCheckpoint));
+        dest += sizeof(ampCheckpoint);
+
+        oversample[i]->saveState(dest);
+        dest += oversample[i]->getStateSize();
+    }
+
+    return block;
+}
+
+bool STRXAudioProcessor::restoreCheckpoint(const void *data, size_t size)
+{
+    CheckpointHeader header;
+    if (size < sizeof(header))
+        return false;
+
+    std::memcpy(&header, data, sizeof(header));
+
+    if (header.magic != checkpointMagic || header.version != checkpointVersion || header.sampleRate != lastDownSampleRate ||
+        header.osIndex != osIndex || !isQualityReady(osIndex))
+        return false;
+
+    const auto range = getQualityOversamplers(osIndex);
+    uint64 expectedBytes = 0;
+    for (int i = range.getStart(); i < range.getEnd(); ++i)
+        expectedBytes += sizeof(AmpProcessor<vec>::Checkpoint) + oversample[i]->getStateSize();
+
+    if (header.numEngines != range.getLength() || header.engineBytes != expectedBytes || size != sizeof(header) + expectedBytes)
+        return false;
+
+    /* every engine is checked before any is touched, so a bad checkpoint leaves the chain as it was */
+    auto *engines = static_cast<const char *>(data) + sizeof(header);
+    AmpProcessor<vec>::Checkpoint ampCheckpoint;
+
+    auto *src = engines;
+    for (int i = range.getStart(); i < range.getEnd(); ++i)
+    {
+        std::memcpy((void *)&ampCheckpoint, src, sizeof(ampCheckpoint));
+        if (!getEngineAmp(i).canRestore(ampCheckpoint))
+            return false;
+
+        src += sizeof(ampCheckpoint) + oversample[i]->getStateSize();
+    }
+
+    src = engines;
+    for (int i = range.getStart(); i < range.getEnd(); ++i)
+    {
+        std::memcpy((void *)&ampCheckpoint, src, sizeof(ampCheckpoint));
+        src += sizeof(ampCheckpoint);
+
+        if (!getEngineAmp(i).restoreCheckpoint(ampCheckpoint))
+        {
+            jassertfalse;
+            return false;
+        }
+
+        oversample[i]->restoreState(src);
+        src += oversample[i]->getStateSize();
+    }
+
+    driveEstimator = header.estimator;
+    autoLevel = header.autoLevel;
+    fadeFromLevel = header.fadeFromLevel;
+    transitionPos = header.transitionPos;
+    lastOutGain = header.lastOutGain;
+    chainSettled = header.chainSettled;
+    gate.restoreCheckpoint(header.gate);
+
+    return true;
+}
+
+bool STRXAudioProcessor::isCheckpointComplete() const
+{
+    return !*cab && !*bypass && softBypass.isFullyActive() && !newMessages && !pendingOversample;
+}
+
+void STRXAudioProcessor::skipBlock(AudioBuffer<double> &input, int numSamples)
+{
+    auto block = dsp::AudioBlock<double>(input).getSubBlock(0, (size_t)numSamples);
+
+    if (getTotalNumInputChannels() == 1)
+        for (size_t ch = 1; ch < block.getNumChannels(); ++ch)
+            block.getSingleChannelBlock(ch).copyFrom(block.getSingleChannelBlock(0));
+
+    softBypass.pushDry(block);
+}
+
+bool STRXAudioProcessor::canPackWith(const STRXAudioProcessor &other) const
+{
+    static const char *const ampParameters[] = {"gain", "mode", "bass", "mid", "treble", "presence", "bright", "tsXgain",
+                                                "master", "channel", "legacyTone", "hq", "renderHQ", "autoHQ", "fixedRate"};
+
+    if (getNumActiveChannels() != 1 || other.getNumActiveChannels() != 1 || *bypass || *other.bypass)
+        return false;
+
+    /* a bypass still fading out wants its warm-up, and auto quality's crossfade scratch only holds the leader's channels */
+    if (!softBypass.isFullyActive() || !other.softBypass.isFullyActive() || isAutoQuality() || other.isAutoQuality())
+        return false;
+
+    if (osIndex != other.osIndex || lastDownSampleRate != other.lastDownSampleRate || pendingOversample || other.pendingOversample)
+        return false;
+
+    for (auto *id : ampParameters)
+        if (apvts.getRawParameterValue(id)->load() != other.apvts.getRawParameterValue(id)->load())
+            return false;
+
+    return true;
+}
+
+void STRXAudioProcessor::processPacked(const std::vector<STRXAudioProcessor *> &group, const std::vector<AudioBuffer<double> *> &buffers, int numSamples)
+{
+    jassert(!group.empty() && group.size() <= vec::size && group.size() == buffers.size());
+
+    const auto start = Time::getHighResolutionTicks();
+
+    std::array<double *, vec::size> lanes{};
+    for (size_t i = 0; i < group.size(); ++i)
+    {
+        auto &p = *group[i];
+        p.callbackTags = 0;
+        if (p.newMessages || p.pendingOversample)
+        {
+            p.callbackTags |= DeadlineMonitor::messages;
+            p.handleMessage();
+        }
+
+        const auto latency = (int)p.oversample[p.osIndex]->getLatencyInSamples();
+        p.setLatencySamples(latency);
+        p.softBypass.setLatency(latency);
+
+        /* keep the dry history fed, so a later bypass or warm-up has it */
+        p.skipBlock(*buffers[i], numSamples);
+
+        lanes[i] = buffers[i]->getWritePointer(0);
+        dsp::AudioBlock<double> mono(&lanes[i], 1, (size_t)numSamples);
+        p.gate.setThreshold(*p.gateThresh);
+        p.gate.process(mono);
+    }
+
+    /* the gate's sub-block skipping is per instance, so the packed pass always runs */
+    dsp::AudioBlock<double> packed(lanes.data(), group.size(), (size_t)numSamples);
+    group[0]->processAmpStage(packed);
+
+    for (size_t i = 0; i < group.size(); ++i)
+    {
+        auto &p = *group[i];
+        auto block = dsp::AudioBlock<double>(*buffers[i]).getSubBlock(0, (size_t)numSamples);
+        auto mono = block.getSingleChannelBlock(0);
+
+        if (*p.cab)
+            p.cabinet.process(mono);
+
+        for (size_t ch = 1; ch < block.getNumChannels(); ++ch)
+            block.getSingleChannelBlock(ch).copyFrom(mono);
+
+        strix::SmoothGain<double>::applySmoothGain(block, std::pow(10.f, *p.outVol_dB * 0.05f), p.lastOutGain);
+    }
+
+    /* every member waited on the whole pass, so each is charged all of it */
+    const auto ticks = Time::getHighResolutionTicks() - start;
+    for (auto *p : group)
+    {
+        const auto load = p->deadlines.record(ticks, numSamples, p->lastDownSampleRate, p->callbackTags);
+        if (p->telemetry.isEnabled())
+            p->telemetry.publish({ticks, numSamples, p->lastDownSampleRate, load > 1.0, p->osIndex, p->getActiveOversamplingFactor()});
+    }
+}
+
+void STRXAudioProcessor::gatherLanes(const std::vector<STRXAudioProcessor *> &group)
+{
+    auto &leader = *group[0];
+    auto &os = *leader.oversample[(size_t)leader.osIndex];
+
+    /* lanes past the group are fed silence, so they start from it too */
+    for (size_t i = 1; i < vec::size; ++i)
+    {
+        auto *member = i < group.size() ? group[i] : nullptr;
+        jassert(member == nullptr || member->osIndex == leader.osIndex);
+
+        leader.amp.copyLane(member != nullptr ? &member->amp : nullptr, 0, i);
+        os.copyLane(member != nullptr ? member->oversample[(size_t)leader.osIndex].get() : nullptr, 0, i);
+    }
+}
+
+void STRXAudioProcessor::scatterLanes(const std::vector<STRXAudioProcessor *> &group)
+{
+    auto &leader = *group[0];
+    auto &os = *leader.oversample[(size_t)leader.osIndex];
+
+    AmpProcessor<vec>::Checkpoint ampState;
+    leader.amp.saveCheckpoint(ampState);
+    MemoryBlock osState(os.getStateSize());
+    os.saveState(osState.getData());
+
+    for (size_t i = 1; i < group.size(); ++i)
+    {
+        auto &member = *group[i];
+        auto &memberOS = *member.oversample[(size_t)leader.osIndex];
+
+        /* the member ran on the leader's smoothers while packed, then takes its own lane */
+        if (member.osIndex != leader.osIndex || !member.amp.restoreCheckpoint(ampState))
+        {
+            jassertfalse;
+            continue;
+        }
+        memberOS.restoreState(osState.getData());
+
+        for (size_t lane = 0; lane < vec::size; ++lane)
+        {
+            member.amp.copyLane(lane == 0 ? &leader.amp : nullptr, i, lane);
+            memberOS.copyLane(lane == 0 ? &os : nullptr, i, lane);
+        }
+    }
+
+    for (size_t lane = 1; lane < vec::size; ++lane)
+    {
+        leader.amp.copyLane(nullptr, 0, lane);
+        os.copyLane(nullptr, 0, lane);
+    }
+}
+
+void STRXAudioProcessor::processAutoLevel(int level, dsp::AudioBlock<double> &block)
+{
+    auto &os = *oversample[autoOversampler + level];
+    auto laneBlock = [&]
+    {
+        const StageProfiler::Scope scope(&profiler, StageProfiler::upsample);
+        return os.processSamplesUp(block);
+    }();
+
+    autoAmps[(size_t)level]->processAmp(laneBlock);
+
+    const StageProfiler::Scope scope(&profiler, StageProfiler::downsample);
+    os.processSamplesDown(block);
+}
+
+void STRXAudioProcessor::processAutoChain(dsp::AudioBlock<double> &block)
+{
+    const auto wanted = driveEstimator.process(block, ampGain->load(), ampMaster->load(), ampTSX->load(), ampChannel->load() > 0.f);
+
+    /* a change of level waits for any transition in progress to finish */
+    if (fadeFromLevel < 0 && wanted != autoLevel)
+    {
+        fadeFromLevel = autoLevel;
+        autoLevel = wanted;
+        transitionPos = 0;
+        oversample[autoOversampler + autoLevel]->reset();
+        autoAmps[(size_t)autoLevel]->reset();
+    }
+
+    if (fadeFromLevel < 0)
+    {
+        processAutoLevel(autoLevel, block);
+        return;
+    }
+
+    callbackTags |= DeadlineMonitor::autoTransition;
+
+    const auto numSamples = block.getNumSamples();
+    auto outgoing = dsp::AudioBlock<double>(fadeBuffer).getSubsetChannelBlock(0, block.getNumChannels()).getSubBlock(0, numSamples);
+    outgoing.copyFrom(block);
+
+    processAutoLevel(fadeFromLevel, outgoing);
+    processAutoLevel(autoLevel, block);
+
+    for (size_t ch = 0; ch < block.getNumChannels(); ++ch)
+    {
+        auto *in = block.getChannelPointer(ch);
+        const auto *out = outgoing.getChannelPointer(ch);
+        for (size_t i = 0; i < numSamples; ++i)
+        {
+            const auto t = jlimit(0.0, 1.0, (double)(transitionPos + (int)i - preRollSamples) / (double)fadeSamples);
+            in[i] = out[i] + t * (in[i] - out[i]);
+        }
+    }
+
+    transitionPos += (int)numSamples;
+    if (transitionPos >= preRollSamples + fadeSamples)
+        fadeFromLevel = -1;
+}
+
+void STRXAudioProcessor::processGatedChain(dsp::AudioBlock<double> &block)
+{
+    if (!gate.isEnabled())
+    {
+        chainSettled = false;
+        processAmpChain(block);
+        return;
+    }
+
+    constexpr auto subBlockSize = NoiseGate::subBlockSize;
+    constexpr double silence = 1.0e-6;
+
+    const auto numSamples = block.getNumSamples();
+    for (size_t start = 0; start < numSamples;)
+    {
+        /* find the run of sub-blocks with the same gate state */
+        const auto closed = gate.isClosed(start / subBlockSize);
+        auto end = jmin(start + subBlockSize, numSamples);
+        while (end < numSamples && gate.isClosed(end / subBlockSize) == closed)
+            end = jmin(end + subBlockSize, numSamples);
+
+        auto run = block.getSubBlock(start, end - start);
+
+        if (closed && chainSettled)
+            run.clear();
+        else
+        {
+            processAmpChain(run);
+
+            /* once the chain's tail has died away with the gate shut, stop running it */
+            if (closed)
+            {
+                const auto lastStart = (end - 1) / subBlockSize * subBlockSize;
+                auto last = block.getSubBlock(lastStart, end - lastStart);
+                const auto range = last.findMinAndMax();
+                chainSettled = jmax(std::abs(range.getStart()), std::abs(range.getEnd())) < silence;
+            }
+            else
+                chainSettled = false;
+        }
+
+        start = end;
+    }
+}
+
+void STRXAudioProcessor::warmUp()
+{
+    resetAmpChain();
+    cabinet.reset();
+    gate.reset();
+    chainSettled = false;
+
+    auto history = softBypass.getHistory();
+    if (history.getNumSamples() == 0)
+        return;
+
+    dsp::AudioBlock<double> block(warmUpBuffer);
+    auto warm = block.getSubBlock(0, history.getNumSamples()).getSubsetChannelBlock(0, getNumActiveChannels());
+    warm.copyFrom(history.getSubsetChannelBlock(0, getNumActiveChannels()));
+    processAmpChain(warm);
+}
+
+void STRXAudioProcessor::processDoubleBuffer(AudioBuffer<double> &buffer, bool hostBypassed)
+{
+    const auto start = Time::getHighResolutionTicks();
+    callbackTags = 0;
+
+    processCallback(buffer, hostBypassed);
+
+    const auto ticks = Time::getHighResolutionTicks() - start;
+    const auto load = deadlines.record(ticks, buffer.getNumSamples(), lastDownSampleRate, callbackTags);
+
+    if (telemetry.isEnabled())
+        telemetry.publish({ticks, buffer.getNumSamples(), lastDownSampleRate, load > 1.0, osIndex, getActiveOversamplingFactor()});
+}
+
+void STRXAudioProcessor::processCallback(AudioBuffer<double> &buffer, bool hostBypassed)
+{
+    if (newMessages || pendingOversample)
+    {
+        callbackTags |= DeadlineMonitor::messages;
         handleMessage();
+    }
 
-    float out_raw = std::pow(10, (*outVol_dB * 0.05f));
+    const auto latency = (int)oversample[osIndex]->getLatencyInSamples();
+    setLatencySamples(latency);
+    softBypass.setLatency(latency);
+    softBypass.setBypassed(hostBypassed || *bypass);
 
     dsp::AudioBlock<double> block(buffer);
 
-    auto osBlock = oversample[osIndex]->processSamplesUp(block);
+    /* mono in, stereo out: the dry path and the copy below both want the input on every channel */
+    if (getTotalNumInputChannels() == 1)
+        for (size_t ch = 1; ch < block.getNumChannels(); ++ch)
+            block.getSingleChannelBlock(ch).copyFrom(block.getSingleChannelBlock(0));
 
-    if (stereo->getIndex())
+    if (softBypass.isFullyBypassed())
     {
-        auto simdBlock = simd.interleaveBlock(osBlock);
-        stereoAmp.processAmp(simdBlock);
-        simd.deinterleaveBlock(simdBlock);
+        softBypass.processBypassed(block);
+        return;
     }
-    else
+
+    if (softBypass.isResuming())
     {
-        auto mono = osBlock.getSingleChannelBlock(0);
-        monoAmp.processAmp(mono);
-        FloatVectorOperations::copy(osBlock.getChannelPointer(1), mono.getChannelPointer(0), mono.getNumSamples());
+        callbackTags |= DeadlineMonitor::warmUp;
+        warmUp();
     }
 
-    oversample[osIndex]->processSamplesDown(block);
-    strix::SmoothGain<double>::applySmoothGain(block, out_raw, lastOutGain);
+    softBypass.pushDry(block);
+    profiler.beginBlock();
+
+    float out_raw = std::pow(10, (*outVol_dB * 0.05f));
+
+    const auto numActive = getNumActiveChannels();
+    auto active = block.getSubsetChannelBlock(0, numActive);
 
-    setLatencySamples(oversample[osIndex]->getLatencyInSamples());
+    gate.setThreshold(*gateThresh);
+    gate.process(active);
+    processGatedChain(active);
+
+    if (isAutoQuality() ? autoAmps[(size_t)autoLevel]->isSmoothing() : amp.isSmoothing())
+        callbackTags |= DeadlineMonitor::smoothing;
+
+    for (size_t ch = numActive; ch < block.getNumChannels(); ++ch)
+        block.getSingleChannelBlock(ch).copyFrom(active.getSingleChannelBlock(0));
+
+    {
+        const StageProfiler::Scope scope(&profiler, StageProfiler::outputGain);
+        strix::SmoothGain<double>::applySmoothGain(block, out_raw, lastOutGain);
+        softBypass.processMix(block);
+    }
+
+    profiler.endBlock((int)block.getNumSamples(), lastDownSampleRate);
 }
 
 //==============================================================================
 bool STRXAudioProcessor::hasEditor() const
 {
-    return true; // (change this to false if you choose to not supply an editor)
+    return !STRX_HEADLESS; // (change this to false if you choose to not supply an editor)
 }
 
 AudioProcessorEditor *STRXAudioProcessor::createEditor()
 {
+#if STRX_HEADLESS
+    return nullptr;
+#else
     return new STRXAudioProcessorEditor(*this);
+#endif
 }
 
 //==============================================================================
 void STRXAudioProcessor::getStateInformation(MemoryBlock &destData)
 {
-    auto state = apvts.copyState();
-    std::unique_ptr<XmlElement> xml(state.createXml());
-    xml->setAttribute("uiWidth", lastUIWidth);
-    xml->setAttribute("uiHeight", lastUIHeight);
-    copyXmlToBinary(*xml, destData);
+    const auto path = cabIRFile.getFullPathName();
+
+    BinaryStateHeader header;
+    header.magic = binaryStateMagic;
+    header.version = binaryStateVersion;
+    header.uiWidth = lastUIWidth;
+    header.uiHeight = lastUIHeight;
+    header.cabIRHash = cabIRHash;
+    header.numParameters = (uint32)stateParameters.size();
+    header.pathSize = (uint32)path.getNumBytesAsUTF8();
+
+    destData.setSize(sizeof(header) + header.numParameters * sizeof(BinaryStateParameter) + header.pathSize);
+    auto *out = static_cast<char*>(destData.getData());
+
+    std::memcpy(out, &header, sizeof(header));
+    out += sizeof(header);
+
+    for (auto &[id, param] : stateParameters)
+    {
+        const BinaryStateParameter entry{id, param->convertFrom0to1(param->getValue())};
+        std::memcpy(out, &entry, sizeof(entry));
+        out += sizeof(entry);
+    }
+
+    std::memcpy(out, path.toRawUTF8(), header.pathSize);
 }
 
 void STRXAudioProcessor::setStateInformation(const void *data, int sizeInBytes)
+{
+    if (sizeInBytes <= 0)
+        return;
+
+    if (!readBinaryState(data, (size_t)sizeInBytes))
+        readXmlState(data, sizeInBytes);
+
+    if (lastDownSampleRate > 0.0)
+        cabinet.setResponse(getCabinetResponse());
+}
+
+bool STRXAudioProcessor::readBinaryState(const void *data, size_t sizeInBytes)
+{
+    BinaryStateHeader header;
+    if (sizeInBytes < sizeof(header))
+        return false;
+
+    std::memcpy(&header, data, sizeof(header));
+    if (header.magic != binaryStateMagic || header.version > binaryStateVersion)
+        return false;
+
+    const auto paramsSize = (size_t)header.numParameters * sizeof(BinaryStateParameter);
+    if (sizeInBytes < sizeof(header) + paramsSize + header.pathSize)
+        return false;
+
+    auto *in = static_cast<const char*>(data) + sizeof(header);
+
+    std::vector<BinaryStateParameter> entries(header.numParameters);
+    std::memcpy(entries.data(), in, paramsSize);
+    in += paramsSize;
+
+    /* parameters missing from older states go back to their defaults, as with replaceState() */
+    for (auto &[id, param] : stateParameters)
+    {
+        auto entry = std::find_if(entries.begin(), entries.end(), [id = id](const auto &e) { return e.id == id; });
+        param->setValueNotifyingHost(entry != entries.end() ? param->convertTo0to1(entry->value) : param->getDefaultValue());
+    }
+
+    lastUIWidth = header.uiWidth;
+    lastUIHeight = header.uiHeight;
+
+    /* the hash lets the cached spectra be used even if the IR file has moved */
+    const auto path = String::fromUTF8(in, (int)header.pathSize);
+    cabIRFile = path.isNotEmpty() ? File(path) : File();
+    cabIRHash = header.cabIRHash;
+
+    if (cabIRHash != 0)
+    {
+        apvts.state.setProperty("cabIR", path, nullptr);
+        apvts.state.setProperty("cabIRHash", String::toHexString((int64)cabIRHash), nullptr);
+    }
+    else
+    {
+        apvts.state.removeProperty("cabIR", nullptr);
+        apvts.state.removeProperty("cabIRHash", nullptr);
+    }
+
+    return true;
+}
+
+/* sessions saved before the binary format */
+void STRXAudioProcessor::readXmlState(const void *data, int sizeInBytes)
 {
     std::unique_ptr<XmlElement> xmlState(getXmlFromBinary(data, sizeInBytes));
     if (xmlState.get() != nullptr)
@@ -278,9 +1156,63 @@ void STRXAudioProcessor::setStateInformation(const void *data, int sizeInBytes)
         lastUIHeight = xmlState->getIntAttribute("uiHeight", lastUIHeight);
         if (xmlState->hasTagName(apvts.state.getType()))
             apvts.replaceState(ValueTree::fromXml(*xmlState));
+
+        const auto path = apvts.state.getProperty("cabIR").toString();
+        cabIRFile = path.isNotEmpty() ? File(path) : File();
+        cabIRHash = (uint64)apvts.state.getProperty("cabIRHash").toString().getHexValue64();
     }
 }
 
+bool STRXAudioProcessor::loadCabinetIR(const File &file)
+{
+    if (!file.existsAsFile())
+        return false;
+
+    /* the library hashes the file as it maps it, so only hash it here if there's no response to build yet */
+    uint64 hash = 0;
+    if (lastDownSampleRate > 0.0)
+    {
+        auto response = irLibrary->getResponse(file, 0, lastDownSampleRate, numSamples);
+        if (response == nullptr)
+            return false;
+
+        hash = response->hash;
+        cabinet.setResponse(std::move(response));
+    }
+    else
+        hash = IRLibrary::hashFile(file);
+
+    if (hash == 0)
+        return false;
+
+    cabIRFile = file;
+    cabIRHash = hash;
+    apvts.state.setProperty("cabIR", file.getFullPathName(), nullptr);
+    apvts.state.setProperty("cabIRHash", String::toHexString((int64)hash), nullptr);
+
+    return true;
+}
+
+void STRXAudioProcessor::clearCabinetIR()
+{
+    cabIRFile = File();
+    cabIRHash = 0;
+    apvts.state.removeProperty("cabIR", nullptr);
+    apvts.state.removeProperty("cabIRHash", nullptr);
+
+    if (lastDownSampleRate > 0.0)
+        cabinet.setResponse(getCabinetResponse());
+}
+
+std::shared_ptr<const CabinetResponse> STRXAudioProcessor::getCabinetResponse()
+{
+    if (cabIRHash != 0)
+        if (auto response = irLibrary->getResponse(cabIRFile, cabIRHash, lastDownSampleRate, numSamples))
+            return response;
+
+    return irLibrary->getResponse(File(), 0, lastDownSampleRate, numSamples);
+}
+
 //==============================================================================
 // This creates new instances of the plugin..
 AudioProcessor *JUCE_CALLTYPE createPluginFilter()
@@ -319,6 +1251,11 @@ AudioProcessorValueTreeState::ParameterLayout STRXAudioProcessor::createParamete
     params.push_back(std::make_unique<bParam>(ParameterID("renderHQ", 1), "Render HQ", false));
     params.push_back(std::make_unique<bParam>(ParameterID("legacyTone", 1), "Use Legacy Tone Controls", false));
     params.push_back(std::make_unique<cParam>(ParameterID("stereo", 1), "Mono/Stereo", StringArray{"Mono", "Stereo"}, 0));
+    params.push_back(std::make_unique<bParam>(ParameterID("bypass", 1), "Bypass", false));
+    params.push_back(std::make_unique<bParam>(ParameterID("cab", 1), "Cabinet", false));
+    params.push_back(std::make_unique<fParam>(ParameterID("gate", 1), "Gate Threshold", NormalisableRange<float>(NoiseGate::offThreshold, -20.f, 0.1f), NoiseGate::offThreshold));
+    params.push_back(std::make_unique<bParam>(ParameterID("autoHQ", 1), "Auto HQ", false));
+    params.push_back(std::make_unique<bParam>(ParameterID("fixedRate", 1), "Fixed Internal Rate", false));
 
     return {params.begin(), params.end()};
 }
\ No newline at end of file
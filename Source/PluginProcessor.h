@@ -10,13 +10,32 @@
 
 #include <JuceHeader.h>
 
+/* 1 for the tool targets, which build the processor without its editor or the plugin wrappers */
+#ifndef STRX_HEADLESS
+#define STRX_HEADLESS 0
+#endif
+
 /*input * (max-min) + min*/
 static float cookParams(float valueToCook, float minValue, float maxValue) 
 {
     return valueToCook * (maxValue - minValue) + minValue;
 }
 
+#include "Filters.hpp"
+#include "DesignCache.hpp"
+#include "Profiler.hpp"
+#include "Deadline.hpp"
+#include "Telemetry.hpp"
+#include "Lanes.hpp"
 #include "STR-X.hpp"
+#include "HalfbandDesign.hpp"
+#include "Oversampler.hpp"
+#include "Pipeline.hpp"
+#include "AutoQuality.hpp"
+#include "Bypass.hpp"
+#include "Gate.hpp"
+#include "Cabinet.hpp"
+#include "IRLibrary.hpp"
 
 // #if NDEBUG
 #define USE_SIMD 1
@@ -26,8 +45,10 @@ static float cookParams(float valueToCook, float minValue, float maxValue)
 /**
 */
 class STRXAudioProcessor  : public AudioProcessor,
-                            public AudioProcessorValueTreeState::Listener,
-                            public clap_juce_extensions::clap_properties
+                            public AudioProcessorValueTreeState::Listener
+#if !STRX_HEADLESS
+                          , public clap_juce_extensions::clap_properties
+#endif
 {
 public:
     //==============================================================================
@@ -37,6 +58,8 @@ public:
     //==============================================================================
     void prepareToPlay (double sampleRate, int samplesPerBlock) override;
     void releaseResources() override;
+    /* clear the processing state, keeping the built engines */
+    void reset() override;
 
    #ifndef JucePlugin_PreferredChannelConfigurations
     bool isBusesLayoutSupported (const BusesLayout& layouts) const override;
@@ -44,7 +67,11 @@ public:
 
     void processBlock (AudioBuffer<float>&, MidiBuffer&) override;
     void processBlock (AudioBuffer<double>&, MidiBuffer&) override;
-    void processDoubleBuffer(AudioBuffer<double> &);
+    void processBlockBypassed (AudioBuffer<float>&, MidiBuffer&) override;
+    void processBlockBypassed (AudioBuffer<double>&, MidiBuffer&) override;
+    void processDoubleBuffer(AudioBuffer<double> &, bool hostBypassed = false);
+
+    AudioProcessorParameter* getBypassParameter() const override { return bypass; }
 
     bool supportsDoublePrecisionProcessing() const override { return true; }
 
@@ -75,17 +102,136 @@ public:
     
     void updateOversample();
 
+    /* message thread: load a cabinet impulse response from an audio file, recalled with the session */
+    bool loadCabinetIR(const File &file);
+    /* message thread: go back to the built-in cabinet response */
+    void clearCabinetIR();
+
+    /* bytes held by the amp engines built so far, including their filter state arenas */
+    size_t getEngineMemoryFootprint() const
+    {
+        auto bytes = amp.getMemoryFootprint();
+        for (auto &a : autoAmps)
+            if (a != nullptr)
+                bytes += a->getMemoryFootprint();
+        return bytes;
+    }
+
     String getWrapperTypeString()
     {
+       #if !STRX_HEADLESS
         if (wrapperType == wrapperType_Undefined && is_clap)
             return "CLAP";
+       #endif
 
         return juce::AudioProcessor::getWrapperTypeDescription(wrapperType);
     }
     
+    /* wall-clock cost of bringing an instance up, for profiling template loads and plugin scans */
+    struct StartupTimings
+    {
+        double constructMs = 0.0, prepareMs = 0.0, backgroundBuildMs = 0.0;
+    };
+
+    StartupTimings getStartupTimings() const { return {constructMs, prepareMs, backgroundBuildMs.load()}; }
+
+    /* per-stage load of the audio callback; read from one thread only, normally the editor's */
+    StageProfiler &getProfiler() { return profiler; }
+
+    /* callback time against the real-time budget: histogram, max, p99, overruns and tagged spikes; one reader thread */
+    DeadlineMonitor::Stats getDeadlineStats() { return deadlines.getStats(); }
+    void resetDeadlineStats() { deadlines.reset(); }
+
+    /**
+     * Offline only: run blocks longer than a pipeline piece in the manual
+     * quality modes as a pipeline, with upsampling, the two halves of the amp
+     * and downsampling each on their own thread. The output is bit-identical
+     * to serial processing. Not while processing.
+     */
+    void setPipelinedRendering(bool shouldPipeline);
+
+    /**
+     * For hosts running many instances offline (BatchEngine, EnginePool):
+     * prepareToPlay builds only the quality in use and starts no background
+     * builder, and a quality change builds the new one in the next callback.
+     * Set before prepareToPlay.
+     */
+    void setBuildOnDemand(bool shouldBuildOnDemand) { buildOnDemand = shouldBuildOnDemand; }
+
+    /**
+     * Processing state of the amp chain as a plain blob: the oversamplers and
+     * amps the current quality runs, auto quality's level and crossfade, the
+     * gate and the output gain. Restoring it into an instance prepared at the
+     * same rate and quality, with the same parameters restored first, carries
+     * on exactly where the checkpoint was taken. The cabinet's convolution
+     * isn't included, so with the cabinet on, start rendering at least an
+     * impulse response early. Between blocks, on the processing thread; an
+     * empty block or false if the quality's engines aren't built yet or the
+     * blob doesn't match.
+     */
+    MemoryBlock saveCheckpoint();
+    bool restoreCheckpoint(const void *data, size_t size);
+
+    /**
+     * Whether a checkpoint holds everything the next block's output depends on
+     * besides the parameters and the input: the cabinet is off, nothing is
+     * bypassed or fading and no quality change is pending. Offline caches only
+     * reuse output across such blocks.
+     */
+    bool isCheckpointComplete() const;
+
+    /**
+     * Offline caches: after restoring the checkpoint from the end of a block
+     * whose output was copied rather than rendered, pass the block's input
+     * here to feed the bypass's dry path as processing it would have.
+     */
+    void skipBlock(AudioBuffer<double> &input, int numSamples);
+
+    /* whether another instance's amp runs with the same settings, so the two can share a lane-packed pass */
+    bool canPackWith(const STRXAudioProcessor &other) const;
+
+    /**
+     * Batch engines only: run the first channel of up to vec::size mono
+     * instances that can pack with the first one as the lanes of a single pass
+     * through its oversampler and amp. Gate, cabinet and output gain still run
+     * per instance and the result is copied to every channel, as in mono. Each
+     * instance's dry path, latency and deadline record are kept up as in
+     * processBlock, but soft bypass isn't mixed, so bypassed instances and
+     * auto quality don't pack.
+     */
+    static void processPacked(const std::vector<STRXAudioProcessor *> &group, const std::vector<AudioBuffer<double> *> &buffers, int numSamples);
+
+    /**
+     * Around a group's packed passes: gatherLanes() moves each member's amp
+     * and oversampler state into its lane of the first one's engines, and
+     * scatterLanes() hands each lane back, with the smoothers the group ran
+     * on, once the group breaks up. Then a stream's output is the same
+     * whether or not it was packed for a while.
+     */
+    static void gatherLanes(const std::vector<STRXAudioProcessor *> &group);
+    static void scatterLanes(const std::vector<STRXAudioProcessor *> &group);
+
+    /* hit rate and memory saved by the filter designs shared across every instance in the process */
+    DesignCache::Stats getDesignCacheStats() const { return designCache->getStats(); }
+
+    /* declared first so construction timing covers the parameter tree */
+    const double constructionStart = Time::getMillisecondCounterHiRes();
+
     AudioProcessorValueTreeState apvts;
 
-    std::vector<std::unique_ptr<dsp::Oversampling<double>>> oversample;
+    /**
+     * Built on demand; only entries flagged in oversampleReady may be used by
+     * the audio thread. 0-2 are 1x, HQ and render HQ; auto quality switches
+     * between the three from autoOversampler, all padded to the same latency.
+     * The last runs the amp at a fixed internal rate whatever the host's.
+     */
+    static constexpr int numOversamplers = 7;
+    static constexpr int autoOversampler = 3;
+    static constexpr int fixedRateOversampler = 6;
+    std::array<std::unique_ptr<LaneOversampler>, numOversamplers> oversample;
+    std::array<std::atomic<bool>, numOversamplers> oversampleReady{};
+    /* the amp's fixed filters at each oversampler's rate, resolved with it so the audio thread never waits on DesignCache */
+    std::array<std::shared_ptr<const AmpDesign>, numOversamplers> ampDesigns;
 
     int lastUIWidth, lastUIHeight;
 
@@ -96,23 +242,158 @@ private:
     double lastDownSampleRate = 0.0;
     int numSamples = 0;
 
-    bool isOversampled = false;
+    /* of the main amp's rate over the host's; auto quality's amps each have their own */
+    int oversampleFactor = 1;
+    bool pendingOversample = false;
+
+    /* index of the oversampler the current quality settings ask for, autoOversampler for auto quality */
+    int getOversampleIndex() const;
+    std::unique_ptr<LaneOversampler> createOversampler(int index);
+    void buildOversampler(int index);
+
+    /* the oversamplers a quality setting runs, which is all three auto ones for auto quality */
+    static Range<int> getQualityOversamplers(int index);
+    bool isQualityReady(int index) const;
+    void buildQuality(int index);
+
+    bool isAutoQuality() const { return osIndex == autoOversampler; }
+
+    /**
+     * Halfband stages taking the host rate as close to 192 kHz as doubling
+     * can without going over: 176.4 kHz from 22.05, 44.1 and 88.2 kHz, 192 kHz
+     * from 24, 48 and 96 kHz. Other rates land short, e.g. 32 and 64 kHz at
+     * 128 kHz, and 176.4 kHz and up run unchanged.
+     */
+    static size_t getFixedRateStages(double sampleRate);
+    static constexpr double maxFixedRate = 192000.0;
+    static constexpr size_t maxFixedRateStages = 3;
+
+    /**
+     * Builds and initialises the inactive oversamplers off the audio and
+     * message threads, then waits for requestBuild() to pick up any that
+     * weren't wanted before. Auto quality's are only wanted once it's been
+     * switched on.
+     */
+    std::thread engineBuilder;
+    std::atomic<bool> cancelBuild = false;
+    bool buildOnDemand = false;
+    WaitableEvent buildRequest;
+    void startBackgroundBuild();
+    void stopBackgroundBuild();
+    void requestBuild() { buildRequest.signal(); }
+    bool isBuildWanted(int index) const { return !getQualityOversamplers(autoOversampler).contains(index) || *autoHQ; }
+
+    dsp::ProcessSpec ampSpec{0.0, 0, 0};
+    void prepareAmp();
+
+    double constructMs = 0.0, prepareMs = 0.0;
+    std::atomic<double> backgroundBuildMs = 0.0;
 
     AudioProcessorValueTreeState::ParameterLayout createParameters();
 
+    /* parameters in the order they're written to the binary state, keyed by a hash of their ID */
+    std::vector<std::pair<uint32, RangedAudioParameter *>> stateParameters;
+    bool readBinaryState(const void *data, size_t sizeInBytes);
+    void readXmlState(const void *data, int sizeInBytes);
+
     NormalisableRange<float> nRange, outVolRange;
 
-    strix::BoolParameter *hq, *renderHQ;
+    strix::BoolParameter *hq, *renderHQ, *autoHQ, *fixedRate, *bypass, *cab;
     strix::ChoiceParameter *stereo;
-    strix::FloatParameter *outVol_dB;
+    strix::FloatParameter *outVol_dB, *gateThresh;
     float lastOutGain = 0.f;
 
-    AudioBuffer<double> doubleBuffer;
+    AudioBuffer<double> doubleBuffer, warmUpBuffer;
 
-    AmpProcessor<vec> stereoAmp;
-    AmpProcessor<double> monoAmp;
+    SoftBypass softBypass;
+
+    StageProfiler profiler;
+
+    DeadlineMonitor deadlines;
+    /* DeadlineMonitor::Tag flags for what the current callback did */
+    uint32 callbackTags = 0;
+
+    TelemetryPublisher telemetry{*this};
+
+    /* the factor the running oversampler works at, 1 while it's being built */
+    int getActiveOversamplingFactor() const
+    {
+        const auto index = isAutoQuality() ? autoOversampler + autoLevel : osIndex;
+        return oversampleReady[(size_t)index] ? (int)oversample[(size_t)index]->getOversamplingFactor() : 1;
+    }
+
+    /* everything processDoubleBuffer does besides timing itself */
+    void processCallback(AudioBuffer<double> &buffer, bool hostBypassed);
+
+    NoiseGate gate;
+    bool chainSettled = false;
+
+    Cabinet cabinet;
+    SharedResourcePointer<IRLibrary> irLibrary;
+
+    /* declared ahead of the engines, which hold a reference to it */
+    SharedResourcePointer<DesignCache> designCache;
+    File cabIRFile;
+    uint64 cabIRHash = 0;
+
+    /* the loaded IR at the current rate, falling back to the built-in response */
+    std::shared_ptr<const CabinetResponse> getCabinetResponse();
+
+    /* oversample, run the amp and downsample in place */
+    void processAmpStage(dsp::AudioBlock<double> &block);
+    /* the amp stage in pieces through the pipeline */
+    std::unique_ptr<StagePipeline> pipeline;
+    void processPipelined(dsp::AudioBlock<double> &block);
+    /* the amp stage, then the cabinet */
+    void processAmpChain(dsp::AudioBlock<double> &block);
+    /* auto quality: run the level the drive estimate asks for, crossfading when it changes */
+    void processAutoChain(dsp::AudioBlock<double> &block);
+    void processAutoLevel(int level, dsp::AudioBlock<double> &block);
+    /* clear the state of the oversamplers and amps the current quality runs */
+    void resetAmpChain();
+    /* run the chain on the gated block, skipping sub-blocks where the gate is closed and the chain has gone silent */
+    void processGatedChain(dsp::AudioBlock<double> &block);
+    /* reset and prime the chain with the input history before resuming from bypass */
+    void warmUp();
+
+    /**
+     * One SIMD engine for every layout: each channel carrying distinct signal
+     * takes a lane, so mono uses one lane and true stereo two, and only those
+     * channels are oversampled. The oversamplers pack and unpack the lanes.
+     */
+    AmpProcessor<vec> amp;
+
+    /**
+     * Auto quality keeps an engine per level, each prepared at its own rate,
+     * so both sides of a switch can run at once. The incoming level starts
+     * from a clean state and runs for a pre-roll before it fades in, and the
+     * latency padding keeps the two in phase across the fade. Each is built
+     * with its level's oversampler the first time auto quality is wanted,
+     * and may only be used while that oversampler is flagged ready.
+     */
+    std::array<std::unique_ptr<AmpProcessor<vec>>, DriveEstimator::numLevels> autoAmps;
+    DriveEstimator driveEstimator;
+    std::atomic<float> *ampGain, *ampMaster, *ampTSX, *ampChannel;
+    int autoLevel = DriveEstimator::numLevels - 1;
+    int fadeFromLevel = -1;
+    int transitionPos = 0, preRollSamples = 0, fadeSamples = 1;
+    AudioBuffer<double> fadeBuffer;
+
+    /* the amp that runs with oversampler `oversamplerIndex` */
+    AmpProcessor<vec> &getEngineAmp(int oversamplerIndex);
+
+    /* every engine that's built, for updates that apply whichever is running */
+    template <typename Function>
+    void forEachAmp(Function &&f)
+    {
+        f(amp);
+        for (int level = 0; level < DriveEstimator::numLevels; ++level)
+            if (oversampleReady[(size_t)(autoOversampler + level)])
+                f(*autoAmps[(size_t)level]);
+    }
 
-    strix::SIMD<double, dsp::AudioBlock<double>, strix::AudioBlock<vec>> simd;
+    /* 2 for true stereo; otherwise only the first channel is processed and copied to the rest */
+    size_t getNumActiveChannels() const { return stereo->getIndex() && getTotalNumInputChannels() > 1 ? 2 : 1; }
 
     std::queue<String> msgs;
     std::mutex mutex;
@@ -124,35 +405,56 @@ private:
         for (size_t i = 0; i < num; ++i)
         {
             auto &msg = msgs.front();
-            if (msg == "renderHQ" || msg == "hq")
+            if (msg == "renderHQ" || msg == "hq" || msg == "autoHQ" || msg == "fixedRate")
+                pendingOversample = true;
+            else if (msg == "legacyTone")
             {
-                updateOversample();
-
-                dsp::ProcessSpec newSpec;
-                newSpec.sampleRate = lastSampleRate;
-                newSpec.maximumBlockSize = numSamples * oversample[osIndex]->getOversamplingFactor();
-                newSpec.numChannels = getTotalNumInputChannels();
-
-                stereoAmp.prepare(newSpec);
-                monoAmp.prepare(newSpec);
-
-                simd.setInterleavedBlockSize(newSpec.numChannels, newSpec.maximumBlockSize);
+                forEachAmp([](auto &a) { a.eq.updateAllFilters(); });
             }
-            else if (msg == "legacyTone")
+            else if (msg == "stereo")
             {
-                stereoAmp.eq.updateAllFilters();
-                monoAmp.eq.updateAllFilters();
+                /* the second lane's state is stale after running mono, so start clean */
+                resetAmpChain();
+                cabinet.reset();
             }
+            else if (msg == "cab")
+                cabinet.reset();
             else if (msg == "mode")
             {
-                stereoAmp.preAmp.needCrossoverUpdate = true;
-                monoAmp.preAmp.needCrossoverUpdate = true;
+                forEachAmp([](auto &a) { a.preAmp.needCrossoverUpdate = true; });
             }
 
             msgs.pop();
         }
 
         newMessages = false;
+
+        if (pendingOversample)
+        {
+            const auto index = getOversampleIndex();
+
+            /* offline there's no deadline, so build it here rather than render at the wrong quality, then let the builder carry on with the rest */
+            if (!isQualityReady(index) && (isNonRealtime() || buildOnDemand))
+            {
+                stopBackgroundBuild();
+                buildQuality(index);
+                startBackgroundBuild();
+            }
+            else if (!isQualityReady(index))
+                requestBuild();
+
+            /* otherwise keep the current quality until the background build has it ready */
+            if (isQualityReady(index))
+            {
+                callbackTags |= DeadlineMonitor::qualityChange;
+                const auto wasAuto = isAutoQuality();
+                updateOversample();
+                prepareAmp();
+                if (isAutoQuality() && !wasAuto)
+                    resetAmpChain();
+                pendingOversample = false;
+            }
+        }
     }
 
     //==============================================================================
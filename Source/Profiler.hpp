@@ -0,0 +1,108 @@
+// Profiler.hpp
+
+#pragma once
+
+/**
+ * Always-on per-stage timing of the audio callback. The audio thread adds up
+ * the high resolution ticks spent in each stage over a block and pushes one
+ * record per block into a lock-free ring; a single reader, normally the
+ * editor, drains it and gets each stage's share of the block's real-time
+ * budget. If the reader falls behind, records are dropped rather than waited
+ * on.
+ */
+class StageProfiler
+{
+public:
+    enum Stage
+    {
+        upsample,
+        ts9,
+        preAmp,
+        toneSection,
+        powerAmp,
+        downsample,
+        outputGain,
+        numStages
+    };
+
+    static const char *getStageName(int stage)
+    {
+        static constexpr const char *names[numStages] = {"Up", "TS", "Pre", "Tone", "Power", "Down", "Out"};
+        return names[stage];
+    }
+
+    /* adds the time from construction to destruction to a stage; does nothing without a profiler */
+    class Scope
+    {
+    public:
+        Scope(StageProfiler *p, Stage s) : profiler(p), stage(s), start(p != nullptr ? Time::getHighResolutionTicks() : 0) {}
+
+        ~Scope()
+        {
+            if (profiler != nullptr)
+                profiler->current[stage] += Time::getHighResolutionTicks() - start;
+        }
+
+    private:
+        StageProfiler *profiler;
+        Stage stage;
+        int64 start;
+
+        JUCE_DECLARE_NON_COPYABLE(Scope)
+    };
+
+    /* audio thread, around the stages of one callback */
+    void beginBlock() { std::fill(current.begin(), current.end(), (int64)0); }
+
+    void endBlock(int numSamples, double sampleRate)
+    {
+        int start1, size1, start2, size2;
+        fifo.prepareToWrite(1, start1, size1, start2, size2);
+        if (size1 > 0)
+        {
+            records[(size_t)start1].ticks = current;
+            records[(size_t)start1].budgetTicks = (double)numSamples / sampleRate * (double)Time::getHighResolutionTicksPerSecond();
+        }
+        fifo.finishedWrite(size1);
+    }
+
+    /* reader thread: drain the ring and return each stage's smoothed load as a fraction of the budget */
+    std::array<double, numStages> getLoads()
+    {
+        int start1, size1, start2, size2;
+        fifo.prepareToRead(fifo.getNumReady(), start1, size1, start2, size2);
+
+        auto read = [this](int start, int size)
+        {
+            for (int i = start; i < start + size; ++i)
+            {
+                const auto &r = records[(size_t)i];
+                for (int s = 0; s < numStages; ++s)
+                    loads[(size_t)s] += ((double)r.ticks[(size_t)s] / r.budgetTicks - loads[(size_t)s]) * smoothing;
+            }
+        };
+
+        read(start1, size1);
+        read(start2, size2);
+        fifo.finishedRead(size1 + size2);
+
+        return loads;
+    }
+
+private:
+    struct Record
+    {
+        std::array<int64, numStages> ticks;
+        double budgetTicks;
+    };
+
+    static constexpr int ringSize = 256;
+    static constexpr double smoothing = 0.05;
+
+    std::array<int64, numStages> current{};
+
+    std::array<Record, ringSize> records{};
+    AbstractFifo fifo{ringSize};
+
+    std::array<double, numStages> loads{};
+};
@@ -0,0 +1,365 @@
+// RenderCache.hpp
+
+#pragma once
+
+#include "PluginProcessor.h"
+
+/**
+ * On-disk store of rendered chunks for offline jobs that render the same
+ * material with the same settings again, such as re-exports after an undo or
+ * A/B comparisons. Each chunk is keyed by a hash of its input, every
+ * parameter, the sample rate, the quality and the processor's checkpoint
+ * from the start of the chunk, and stores the output along with the
+ * checkpoint from its end. A hit restores that checkpoint and copies the
+ * output out of the mapped file, so the next chunk starts from exactly the
+ * state rendering would have left and a run of hits is bit-identical to
+ * rendering.
+ *
+ * Chunks are only looked up and stored while the checkpoint captures the
+ * whole chain (see STRXAudioProcessor::isCheckpointComplete); with the
+ * cabinet on, bypassed or with a quality change pending they're rendered.
+ *
+ * Entries are evicted least recently used first once the store grows past
+ * its capacity. Recency is kept in the files' modification times, so it
+ * carries over between runs. Safe to share between threads.
+ */
+class RenderCache
+{
+public:
+    struct Stats
+    {
+        uint64 hits = 0, misses = 0, uncacheable = 0;
+        int64 bytes = 0;
+        int entries = 0;
+    };
+
+    explicit RenderCache(const File &directoryToUse = getDefaultDirectory(), int64 capacityInBytes = (int64)1 << 30)
+        : directory(directoryToUse), capacity(capacityInBytes)
+    {
+        scan();
+    }
+
+    static File getDefaultDirectory()
+    {
+        return File::getSpecialLocation(File::userApplicationDataDirectory)
+            .getChildFile("Arboreal Audio")
+            .getChildFile("STR-X")
+            .getChildFile("RenderCache");
+    }
+
+    /**
+     * Render the first numSamples of `buffer` in place through `processor`, in
+     * blocks of its prepared size, or copy them from the store. For the same
+     * output as an uncached render, chunk the job the same way each time.
+     * Returns true on a hit.
+     */
+    bool process(STRXAudioProcessor &processor, AudioBuffer<double> &buffer, int numSamples)
+    {
+        if (!processor.isCheckpointComplete())
+        {
+            render(processor, buffer, numSamples);
+            const ScopedLock sl(lock);
+            ++stats.uncacheable;
+            return false;
+        }
+
+        const auto start = processor.saveCheckpoint();
+        if (start.isEmpty())
+        {
+            render(processor, buffer, numSamples);
+            const ScopedLock sl(lock);
+            ++stats.uncacheable;
+            return false;
+        }
+
+        const auto key = makeKey(processor, start, buffer, numSamples);
+
+        if (load(key, processor, buffer, numSamples))
+            return true;
+
+        render(processor, buffer, numSamples);
+        store(key, processor.saveCheckpoint(), buffer, numSamples);
+        return false;
+    }
+
+    Stats getStats() const
+    {
+        const ScopedLock sl(lock);
+        auto s = stats;
+        s.bytes = totalBytes;
+        s.entries = (int)index.size();
+        return s;
+    }
+
+    /* delete every entry */
+    void clear()
+    {
+        const ScopedLock sl(lock);
+        for (auto &name : order)
+            directory.getChildFile(name).deleteFile();
+
+        order.clear();
+        index.clear();
+        totalBytes = 0;
+    }
+
+private:
+    /* 128 bits, from two 64-bit FNV-1a streams with different offsets */
+    struct Key
+    {
+        uint64 a = 14695981039346656037ull, b = 0x6c62272e07bb0142ull;
+
+        void add(const void *data, size_t size)
+        {
+            auto *bytes = static_cast<const uint8 *>(data);
+            for (size_t i = 0; i < size; ++i)
+            {
+                a = (a ^ bytes[i]) * 1099511628211ull;
+                b = (b ^ bytes[i]) * 1099511628211ull;
+            }
+        }
+
+        template <typename T>
+        void add(const T &value) { add(&value, sizeof(value)); }
+
+        String getFileName() const
+        {
+            return String::toHexString((int64)a).paddedLeft('0', 16) + String::toHexString((int64)b).paddedLeft('0', 16) + fileExtension;
+        }
+    };
+
+    static Key makeKey(STRXAudioProcessor &processor, const MemoryBlock &checkpoint, const AudioBuffer<double> &buffer, int numSamples)
+    {
+        Key key;
+        key.add(processor.getSampleRate());
+        key.add(processor.getBlockSize());
+        key.add(processor.isNonRealtime());
+
+        /* hashed as bytes: saveCheckpoint() zeroes every struct's padding, so the same state always gives the same key */
+        key.add(checkpoint.getData(), checkpoint.getSize());
+
+        for (auto *param : processor.getParameters())
+            if (auto *ranged = dynamic_cast<RangedAudioParameter *>(param))
+            {
+                const auto &id = ranged->paramID;
+                key.add(id.toRawUTF8(), id.getNumBytesAsUTF8());
+                key.add(ranged->getValue());
+            }
+
+        key.add(buffer.getNumChannels());
+        key.add(numSamples);
+        for (int ch = 0; ch < buffer.getNumChannels(); ++ch)
+            key.add(buffer.getReadPointer(ch), (size_t)numSamples * sizeof(double));
+
+        return key;
+    }
+
+    static void render(STRXAudioProcessor &processor, AudioBuffer<double> &buffer, int numSamples)
+    {
+        const auto blockSize = jmax(1, processor.getBlockSize());
+        MidiBuffer midi;
+
+        for (int pos = 0; pos < numSamples; pos += blockSize)
+        {
+            const auto n = jmin(blockSize, numSamples - pos);
+            AudioBuffer<double> block(buffer.getArrayOfWritePointers(), buffer.getNumChannels(), pos, n);
+            processor.processBlock(block, midi);
+        }
+    }
+
+    struct EntryHeader
+    {
+        char magic[8];
+        uint32 version, numChannels, numSamples, checkpointSize;
+        uint64 keyA, keyB;
+        uint8 padding[24];
+    };
+
+    static_assert(sizeof(EntryHeader) == 64, "render cache header must be one cache line");
+
+    static constexpr char entryMagic[8] = {'S', 'T', 'R', 'X', 'R', 'C', 'H', 0};
+    /* 2: keys no longer include uninitialised checkpoint padding, so older entries could never hit again */
+    static constexpr uint32 entryVersion = 2;
+    static constexpr const char *fileExtension = ".strxrc";
+
+    bool load(const Key &key, STRXAudioProcessor &processor, AudioBuffer<double> &buffer, int numSamples)
+    {
+        const auto name = key.getFileName();
+        const auto file = directory.getChildFile(name);
+
+        {
+            const ScopedLock sl(lock);
+            if (index.find(name) == index.end())
+            {
+                ++stats.misses;
+                return false;
+            }
+        }
+
+        MemoryMappedFile map(file, MemoryMappedFile::readOnly);
+        const auto dataBytes = (size_t)buffer.getNumChannels() * (size_t)numSamples * sizeof(double);
+        uint32 checkpointSize = 0;
+        auto *data = getEntryData(map, key, buffer.getNumChannels(), numSamples, checkpointSize);
+
+        /* the checkpoint is checked before anything changes, so a bad entry leaves the processor as it was */
+        if (data == nullptr || !processor.restoreCheckpoint(data + dataBytes, checkpointSize))
+        {
+            const ScopedLock sl(lock);
+            remove(name);
+            file.deleteFile();
+            ++stats.misses;
+            return false;
+        }
+
+        processor.skipBlock(buffer, numSamples);
+
+        auto *samples = reinterpret_cast<const double *>(data);
+        for (int ch = 0; ch < buffer.getNumChannels(); ++ch)
+            std::memcpy(buffer.getWritePointer(ch), samples + (size_t)ch * (size_t)numSamples, (size_t)numSamples * sizeof(double));
+
+        const ScopedLock sl(lock);
+        touch(name);
+        file.setLastModificationTime(Time::getCurrentTime());
+        ++stats.hits;
+        return true;
+    }
+
+    /* the samples following the header of a mapped entry, or nullptr if it isn't the entry for this key and shape */
+    static const char *getEntryData(const MemoryMappedFile &map, const Key &key, int numChannels, int numSamples, uint32 &checkpointSize)
+    {
+        if (map.getData() == nullptr || map.getSize() < sizeof(EntryHeader))
+            return nullptr;
+
+        EntryHeader header;
+        std::memcpy(&header, map.getData(), sizeof(EntryHeader));
+
+        const auto dataBytes = (size_t)numChannels * (size_t)numSamples * sizeof(double);
+        if (std::memcmp(header.magic, entryMagic, sizeof(entryMagic)) != 0
+            || header.version != entryVersion
+            || header.keyA != key.a || header.keyB != key.b
+            || header.numChannels != (uint32)numChannels
+            || header.numSamples != (uint32)numSamples
+            || map.getSize() != sizeof(EntryHeader) + dataBytes + header.checkpointSize)
+            return nullptr;
+
+        checkpointSize = header.checkpointSize;
+        return static_cast<const char *>(map.getData()) + sizeof(EntryHeader);
+    }
+
+    void store(const Key &key, const MemoryBlock &end, const AudioBuffer<double> &buffer, int numSamples)
+    {
+        if (end.isEmpty() || directory.createDirectory().failed())
+            return;
+
+        EntryHeader header{};
+        std::memcpy(header.magic, entryMagic, sizeof(entryMagic));
+        header.version = entryVersion;
+        header.numChannels = (uint32)buffer.getNumChannels();
+        header.numSamples = (uint32)numSamples;
+        header.checkpointSize = (uint32)end.getSize();
+        header.keyA = key.a;
+        header.keyB = key.b;
+
+        const auto name = key.getFileName();
+        const auto file = directory.getChildFile(name);
+
+        /* write to a temp file and move it in place, so a reader never maps a partial entry */
+        const auto temp = file.getNonexistentSibling();
+        {
+            FileOutputStream out(temp);
+            if (!out.openedOk())
+                return;
+
+            out.write(&header, sizeof(header));
+            for (int ch = 0; ch < buffer.getNumChannels(); ++ch)
+                out.write(buffer.getReadPointer(ch), (size_t)numSamples * sizeof(double));
+            out.write(end.getData(), end.getSize());
+
+            out.flush();
+            if (out.getStatus().failed())
+            {
+                temp.deleteFile();
+                return;
+            }
+        }
+
+        if (!temp.moveFileTo(file))
+        {
+            temp.deleteFile();
+            return;
+        }
+
+        const ScopedLock sl(lock);
+        remove(name);
+        add(name, file.getSize());
+        evict();
+    }
+
+    /* index the entries already on disk, oldest first */
+    void scan()
+    {
+        auto files = directory.findChildFiles(File::findFiles, false, String("*") + fileExtension);
+        std::sort(files.begin(), files.end(), [](const File &x, const File &y)
+                  { return x.getLastModificationTime() < y.getLastModificationTime(); });
+
+        const ScopedLock sl(lock);
+        for (auto &f : files)
+            add(f.getFileName(), f.getSize());
+        evict();
+    }
+
+    /* the index is guarded by lock from here on */
+
+    void add(const String &name, int64 size)
+    {
+        order.push_front(name);
+        index[name] = {order.begin(), size};
+        totalBytes += size;
+    }
+
+    void remove(const String &name)
+    {
+        const auto it = index.find(name);
+        if (it == index.end())
+            return;
+
+        totalBytes -= it->second.size;
+        order.erase(it->second.position);
+        index.erase(it);
+    }
+
+    void touch(const String &name)
+    {
+        const auto it = index.find(name);
+        if (it != index.end())
+            order.splice(order.begin(), order, it->second.position);
+    }
+
+    void evict()
+    {
+        while (totalBytes > capacity && !order.empty())
+        {
+            const auto name = order.back();
+            remove(name);
+            directory.getChildFile(name).deleteFile();
+        }
+    }
+
+    struct Entry
+    {
+        std::list<String>::iterator position;
+        int64 size;
+    };
+
+    const File directory;
+    const int64 capacity;
+
+    CriticalSection lock;
+    /* most recently used first */
+    std::list<String> order;
+    std::map<String, Entry> index;
+    int64 totalBytes = 0;
+    Stats stats;
+
+    JUCE_DECLARE_NON_COPYABLE(RenderCache)
+};
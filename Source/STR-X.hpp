@@ -1,74 +1,129 @@
 #pragma once
 
+/**
+ * All per-sample filter state and coefficients of one AmpProcessor, kept in a
+ * single cache-line-aligned block and laid out in processing order. The stages
+ * below only hold references into it.
+ */
 template <typename Type>
-class TS9
+struct alignas(64) AmpState
 {
-public:
-    TS9() = default;
+    // TS9
+    FirstOrderTPT<Type> tsHPF, tsLPF, tsLPF2;
 
-    void prepare(const dsp::ProcessSpec &spec) noexcept
-    {
-        HPF.prepare(spec);
-        LPF.prepare(spec);
-        LPF_2.prepare(spec);
+    // PreAmp
+    LinkwitzRiley<Type> crossover;
+    Biquad<Type> inputHPF, preDCRemoval, lowShelf;
 
-        HPF.setType(strix::FilterType::firstOrderHighpass);
-        LPF.setType(strix::FilterType::firstOrderLowpass);
-        LPF_2.setType(strix::FilterType::firstOrderLowpass);
+    // ToneSection
+    Biquad<Type> lowPass, highPass, bandPass, bass, mid, treble, presence, brightShelf;
 
-        HPF.setCutoffFreq(720.0);
-        LPF.setCutoffFreq(5600.0);
-        LPF_2.setCutoffFreq(723.4);
-    }
+    // ClassBValvePair
+    Biquad<Type> powerDCRemoval;
 
-    void reset()
+    /* pairs up every filter's state in two arenas, for moving lanes between engines */
+    template <typename Visit>
+    static void visitState(const AmpState &from, AmpState &to, Visit &&visit)
     {
-        HPF.reset();
-        LPF.reset();
-        LPF_2.reset();
+        for (auto f : {&AmpState::tsHPF, &AmpState::tsLPF, &AmpState::tsLPF2})
+            FirstOrderTPT<Type>::visitState(from.*f, to.*f, visit);
+
+        LinkwitzRiley<Type>::visitState(from.crossover, to.crossover, visit);
+
+        for (auto f : {&AmpState::inputHPF, &AmpState::preDCRemoval, &AmpState::lowShelf, &AmpState::lowPass, &AmpState::highPass,
+                       &AmpState::bandPass, &AmpState::bass, &AmpState::mid, &AmpState::treble, &AmpState::presence,
+                       &AmpState::brightShelf, &AmpState::powerDCRemoval})
+            Biquad<Type>::visitState(from.*f, to.*f, visit);
     }
+};
+
+/**
+ * Coefficients of the amp's fixed filters at one sample rate, shared between
+ * engines through DesignCache. Each engine copies them into its own AmpState.
+ */
+struct AmpDesign
+{
+    using Coeffs = dsp::IIR::ArrayCoefficients<double>;
+
+    double sampleRate;
+    double tsHPF, tsLPF, tsLPF2;
+    std::array<double, 6> preDCRemoval, lowShelf, inputHPF;
+    std::array<double, 4> toneHighPass, toneLowPass;
+    std::array<double, 6> toneBandPass, brightShelf;
+    std::array<double, 6> powerDCRemoval;
+
+    explicit AmpDesign(double sampleRateToUse)
+        : sampleRate(sampleRateToUse),
+          tsHPF(FirstOrderTPT<double>::getCoefficient(sampleRate, 720.0)),
+          tsLPF(FirstOrderTPT<double>::getCoefficient(sampleRate, 5600.0)),
+          tsLPF2(FirstOrderTPT<double>::getCoefficient(sampleRate, 723.4)),
+          preDCRemoval(Coeffs::makeHighPass(sampleRate, 10.0)),
+          lowShelf(Coeffs::makeLowShelf(sampleRate, 185.0, 1.8, 0.5)),
+          inputHPF(Coeffs::makeHighPass(sampleRate, 65.0)),
+          toneHighPass(Coeffs::makeFirstOrderHighPass(sampleRate, 750.f)),
+          toneLowPass(Coeffs::makeFirstOrderLowPass(sampleRate, 10000.f)),
+          toneBandPass(Coeffs::makeBandPass(sampleRate, 80.f)),
+          brightShelf(Coeffs::makeHighShelf(sampleRate, 2500.0, 0.707, 2.0)),
+          powerDCRemoval(Coeffs::makeHighPass(sampleRate, 10.0))
+    {
+    }
+
+    size_t getMemoryFootprint() const { return sizeof(*this); }
+};
 
-    inline void process(double *x, double drive, int numSamples)
+//==================================================================
+
+template <typename Type>
+class TS9
+{
+public:
+    TS9(AmpState<Type> &state) : HPF(state.tsHPF), LPF(state.tsLPF), LPF_2(state.tsLPF2)
     {
-        for (int i = 0; i < numSamples; ++i)
-            x[i] = processSample(x[i], drive);
     }
 
-    inline void process(vec *x, vec drive, int numSamples)
+    void prepare(const AmpDesign &design) noexcept
     {
-        for (int i = 0; i < numSamples; ++i)
-            x[i] = processSample(x[i], drive);
+        HPF.G = design.tsHPF;
+        LPF.G = design.tsLPF;
+        LPF_2.G = design.tsLPF2;
     }
 
-private:
-    inline double processSample(double x, double drive)
+    /* the drive smoother starts on `drive`, so a reset engine doesn't glide from where it was */
+    void reset(float drive)
     {
-        double yn = 0.0;
-        double xDry = x;
-        double currentGain = drive;
-
-        if (currentGain != lastGain)
-            lastGain = 0.001f * currentGain + (1.0 - 0.001f) * lastGain;
-        else
-            lastGain = drive;
+        HPF.reset();
+        LPF.reset();
+        LPF_2.reset();
 
+        lastGain = drive;
         k = 2.0 * drive;
+    }
 
-        x *= drive / 2;
-
-        x = HPF.processSample(0, x);
-
-        x = LPF.processSample(0, x);
-
-        x = std::tanh(k * x) / std::tanh(k);
+    /* state outside the AmpState arena */
+    struct Checkpoint
+    {
+        Type lastGain, k;
+    };
 
-        x = LPF_2.processSample(0, x);
+    void saveCheckpoint(Checkpoint &c) const
+    {
+        c.lastGain = lastGain;
+        c.k = k;
+    }
 
-        yn = ((x * (drive / 10.f)) + (xDry * (1.f - (drive / 10.f))));
+    void restoreCheckpoint(const Checkpoint &c)
+    {
+        lastGain = c.lastGain;
+        k = c.k;
+    }
 
-        return yn;
+    inline void process(vec *x, vec drive, int numSamples)
+    {
+        for (int i = 0; i < numSamples; ++i)
+            x[i] = processSample(x[i], drive);
     }
 
+private:
     inline vec processSample(vec x, vec drive)
     {
         vec yn = 0.0;
@@ -84,13 +139,13 @@ private:
 
         x *= drive / 2;
 
-        x = HPF.processSample(0, x);
+        x = HPF.processHighpass(x);
 
-        x = LPF.processSample(0, x);
+        x = LPF.processLowpass(x);
 
         x = xsimd::tanh(k * x) / xsimd::tanh(k);
 
-        x = LPF_2.processSample(0, x);
+        x = LPF_2.processLowpass(x);
 
         yn = ((x * (drive / 10.0)) + (xDry * (1.0 - (drive / 10.0))));
 
@@ -99,7 +154,7 @@ private:
 
     Type lastGain = 0.0;
 
-    strix::SVTFilter<Type> HPF, LPF, LPF_2;
+    FirstOrderTPT<Type> &HPF, &LPF, &LPF_2;
 
     Type k = 0.0;
 };
@@ -110,34 +165,44 @@ template <typename Type>
 class PreAmp
 {
 public:
-    PreAmp(strix::FloatParameter *inGain, strix::ChoiceParameter *crossover, strix::ChoiceParameter *channel) : inGain(inGain), xover(crossover), channel(channel)
+    PreAmp(AmpState<Type> &state, strix::FloatParameter *inGain, strix::ChoiceParameter *crossover)
+        : lr(state.crossover), inputHPF(state.inputHPF), dcRemoval(state.preDCRemoval), lowShelf(state.lowShelf),
+          inGain(inGain), xover(crossover)
     {
     }
 
-    void prepare(const dsp::ProcessSpec &spec) noexcept
+    void prepare(const dsp::ProcessSpec &spec, const AmpDesign &design) noexcept
     {
-        inputHPF.prepare(spec);
-        dcRemoval.prepare(spec);
-        lowShelf.prepare(spec);
-
-        lr.prepare(spec);
-        lr.setType(strix::LRFilterType::lowpass);
+        SR = spec.sampleRate;
 
-        dcRemoval.coefficients = (dsp::IIR::Coefficients<double>::makeHighPass(spec.sampleRate, 10.0));
-        lowShelf.coefficients = (dsp::IIR::Coefficients<double>::makeLowShelf(spec.sampleRate, 185.0, 1.8, 0.5));
-        inputHPF.coefficients = (dsp::IIR::Coefficients<double>::makeHighPass(spec.sampleRate, 65.0));
+        dcRemoval.setCoefficients(design.preDCRemoval);
+        lowShelf.setCoefficients(design.lowShelf);
+        inputHPF.setCoefficients(design.inputHPF);
+        updateCrossover(*xover);
 
         gain.reset(spec.maximumBlockSize);
     }
 
+    /* like the other stages' gain smoothers, the input gain starts on its target */
     void reset()
     {
         inputHPF.reset();
         dcRemoval.reset();
         lowShelf.reset();
         lr.reset();
+        gain.setCurrentAndTargetValue(*inGain);
     }
 
+    /* state outside the AmpState arena */
+    struct Checkpoint
+    {
+        SmoothedValue<float> gain;
+    };
+
+    void saveCheckpoint(Checkpoint &c) const { c.gain = gain; }
+
+    void restoreCheckpoint(const Checkpoint &c) { gain = c.gain; }
+
     std::atomic<bool> needCrossoverUpdate = false;
 
     void updateCrossover(int crossover)
@@ -145,22 +210,22 @@ public:
         switch (crossover)
         {
         case 0:
-            lr.setCutoffFrequency(100.0);
+            lr.setCutoffFreq(SR, 100.0);
             break;
         case 1:
-            lr.setCutoffFrequency(250.0);
+            lr.setCutoffFreq(SR, 250.0);
             break;
         case 2:
-            lr.setCutoffFrequency(400.0);
+            lr.setCutoffFreq(SR, 400.0);
             break;
         default:
-            lr.setCutoffFrequency(250.0);
+            lr.setCutoffFreq(SR, 250.0);
             break;
         }
     }
 
-    template <typename Block>
-    void process(Block &block)
+    /* per-block setup, call once before process() */
+    void prepareBlock()
     {
         if (needCrossoverUpdate)
         {
@@ -169,15 +234,16 @@ public:
         }
 
         gain.setTargetValue(*inGain);
+    }
 
-        if (*channel)
+    template <bool HiGain, typename Block>
+    void process(Block &block)
+    {
+        for (size_t ch = 0; ch < block.getNumChannels(); ++ch)
         {
-            for (size_t ch = 0; ch < block.getNumChannels(); ++ch)
+            if constexpr (HiGain)
                 processHiGain(block.getChannelPointer(ch), block.getNumSamples());
-        }
-        else
-        {
-            for (size_t ch = 0; ch < block.getNumChannels(); ++ch)
+            else
                 processLoGain(block.getChannelPointer(ch), block.getNumSamples());
         }
     }
@@ -206,7 +272,7 @@ private:
 
         xn *= gain_;
 
-        lr.processSample(0, xn, xnL, xnH);
+        lr.processSample(xn, xnL, xnH);
 
         xnL = inputHPF.processSample(xnL);
 
@@ -232,7 +298,7 @@ private:
 
         xn *= gain_;
 
-        lr.processSample(0, xn, xnL, xnH);
+        lr.processSample(xn, xnL, xnH);
 
         // xnL = inputHPF.processSample(xnL);
 
@@ -251,37 +317,6 @@ private:
         return yn;
     }
 
-    inline double hiGainSaturation(double x)
-    {
-        double k = gain.getCurrentValue() / 3.0;
-        double nk = k / 0.9;
-
-        if (x > 0.0)
-        {
-            x = std::atan(k * x) / std::atan(k);
-        }
-        else
-        {
-            x = 0.9 * std::atan(nk * x) / std::atan(nk);
-        }
-
-        return x;
-    }
-
-    inline double loGainSaturation(double x)
-    {
-        if (x > 0.0)
-        {
-            x = (x / (1.0 + std::abs(x))) * 2.0;
-        }
-        else
-        {
-            x = (2.0 * x) / (1.0 + std::abs(x * 2.0));
-        }
-
-        return x;
-    }
-
     inline vec hiGainSaturation(vec x)
     {
         vec k = gain.getCurrentValue() / 3.0;
@@ -297,13 +332,14 @@ private:
         return xsimd::select(x > 0.0, (x / (1.0 + xsimd::abs(x))) * 2.0, (2.0 * x) / (1.0 + xsimd::abs(x * 2.0)));
     }
 
-    strix::LinkwitzRileyFilter<Type> lr;
+    LinkwitzRiley<Type> &lr;
+
+    Biquad<Type> &inputHPF, &dcRemoval, &lowShelf;
 
-    dsp::IIR::Filter<Type> inputHPF, dcRemoval, lowShelf;
+    double SR = 44100.0;
 
     strix::FloatParameter *inGain = nullptr;
     strix::ChoiceParameter *xover = nullptr;
-    strix::ChoiceParameter *channel = nullptr;
 
     SmoothedValue<float> gain;
 };
@@ -313,7 +349,10 @@ private:
 template <typename Type>
 struct ToneSection
 {
-    ToneSection(AudioProcessorValueTreeState &v) : apvts(v)
+    ToneSection(AudioProcessorValueTreeState &v, AmpState<Type> &state)
+        : highPass(state.highPass), bandPass(state.bandPass), lowPass(state.lowPass),
+          bass(state.bass), mid(state.mid), treble(state.treble), presence(state.presence), brightShelf(state.brightShelf),
+          apvts(v)
     {
         bass_p = static_cast<strix::FloatParameter *>(apvts.getParameter("bass"));
         mid_p = static_cast<strix::FloatParameter *>(apvts.getParameter("mid"));
@@ -323,9 +362,9 @@ struct ToneSection
         legacy_p = static_cast<strix::BoolParameter *>(apvts.getParameter("legacyTone"));
     }
 
-    dsp::IIR::Filter<Type> highPass, bandPass, lowPass, bass, mid, treble, presence, brightShelf;
+    Biquad<Type> &highPass, &bandPass, &lowPass, &bass, &mid, &treble, &presence, &brightShelf;
 
-    std::vector<dsp::IIR::Filter<Type> *> getFilters()
+    std::vector<Biquad<Type> *> getFilters()
     {
         return {
             &highPass,
@@ -348,14 +387,14 @@ struct ToneSection
             &pres_s};
     }
 
-    void prepare(const dsp::ProcessSpec &spec)
+    void prepare(const dsp::ProcessSpec &spec, const AmpDesign &design)
     {
         SR = spec.sampleRate;
 
-        highPass.coefficients = (dsp::IIR::Coefficients<double>::makeFirstOrderHighPass(spec.sampleRate, 750.f));
-        bandPass.coefficients = (dsp::IIR::Coefficients<double>::makeBandPass(spec.sampleRate, 80.f));
-        lowPass.coefficients = (dsp::IIR::Coefficients<double>::makeFirstOrderLowPass(spec.sampleRate, 10000.f));
-        brightShelf.coefficients = (dsp::IIR::Coefficients<double>::makeHighShelf(spec.sampleRate, 2500.0, 0.707, 2.0));
+        highPass.setCoefficients(design.toneHighPass);
+        bandPass.setCoefficients(design.toneBandPass);
+        lowPass.setCoefficients(design.toneLowPass);
+        brightShelf.setCoefficients(design.brightShelf);
 
         updateAllFilters();
 
@@ -369,6 +408,28 @@ struct ToneSection
             f->reset();
     }
 
+    /* state outside the AmpState arena */
+    struct Checkpoint
+    {
+        std::array<SmoothedValue<float>, 4> smoothers;
+        int smoothingMask;
+    };
+
+    void saveCheckpoint(Checkpoint &c) const
+    {
+        c.smoothers = {bass_s, mid_s, treble_s, pres_s};
+        c.smoothingMask = smoothingMask;
+    }
+
+    void restoreCheckpoint(const Checkpoint &c)
+    {
+        bass_s = c.smoothers[0];
+        mid_s = c.smoothers[1];
+        treble_s = c.smoothers[2];
+        pres_s = c.smoothers[3];
+        smoothingMask = c.smoothingMask;
+    }
+
     void updateAllFilters()
     {
         float bassParam = *bass_p;
@@ -405,10 +466,10 @@ struct ToneSection
             trebleCook = cookParams(trebleParam, 0.2f, 3.0f);
             presenceCook = cookParams(presenceParam, 0.4f, 2.5f);
         }
-        bass.coefficients = (dsp::IIR::Coefficients<double>::makeLowShelf(SR, 150.f, 0.606f, bassCook));
-        mid.coefficients = (dsp::IIR::Coefficients<double>::makePeakFilter(SR, 600.f, 0.5f, midCook));
-        treble.coefficients = (dsp::IIR::Coefficients<double>::makeHighShelf(SR, 1500.f, 0.3f, trebleCook));
-        presence.coefficients = (dsp::IIR::Coefficients<double>::makePeakFilter(SR, 4000.f, 0.6f, presenceCook));
+        bass.setCoefficients(dsp::IIR::ArrayCoefficients<double>::makeLowShelf(SR, 150.f, 0.606f, bassCook));
+        mid.setCoefficients(dsp::IIR::ArrayCoefficients<double>::makePeakFilter(SR, 600.f, 0.5f, midCook));
+        treble.setCoefficients(dsp::IIR::ArrayCoefficients<double>::makeHighShelf(SR, 1500.f, 0.3f, trebleCook));
+        presence.setCoefficients(dsp::IIR::ArrayCoefficients<double>::makePeakFilter(SR, 4000.f, 0.6f, presenceCook));
     }
 
     /**
@@ -429,7 +490,7 @@ struct ToneSection
             }
             else
                 newValue = cookParams(newValue, 0.2f, 1.666f);
-            *bass.coefficients = (dsp::IIR::ArrayCoefficients<double>::makeLowShelf(SR, 150.f, 0.606f, newValue));
+            bass.setCoefficients(dsp::IIR::ArrayCoefficients<double>::makeLowShelf(SR, 150.f, 0.606f, newValue));
             break;
         case 1 << 1:
             if (!*legacy_p)
@@ -439,7 +500,7 @@ struct ToneSection
             }
             else
                 newValue = cookParams(newValue, 0.3f, 2.2f);
-            *mid.coefficients = (dsp::IIR::ArrayCoefficients<double>::makePeakFilter(SR, 600.f, 0.5f, newValue));
+            mid.setCoefficients(dsp::IIR::ArrayCoefficients<double>::makePeakFilter(SR, 600.f, 0.5f, newValue));
             break;
         case 1 << 2:
             if (!*legacy_p)
@@ -449,7 +510,7 @@ struct ToneSection
             }
             else
                 newValue = cookParams(newValue, 0.2f, 3.0f);
-            *treble.coefficients = (dsp::IIR::ArrayCoefficients<double>::makeHighShelf(SR, 1500.f, 0.3f, newValue));
+            treble.setCoefficients(dsp::IIR::ArrayCoefficients<double>::makeHighShelf(SR, 1500.f, 0.3f, newValue));
             break;
         case 1 << 3:
             if (!*legacy_p)
@@ -459,29 +520,39 @@ struct ToneSection
             }
             else
                 newValue = cookParams(newValue, 0.4f, 2.5f);
-            *presence.coefficients = (dsp::IIR::ArrayCoefficients<double>::makePeakFilter(SR, 4000.f, 0.6f, newValue));
+            presence.setCoefficients(dsp::IIR::ArrayCoefficients<double>::makePeakFilter(SR, 4000.f, 0.6f, newValue));
             break;
         }
     }
 
-    template <typename Block>
-    void process(Block &block)
+    /**
+     * per-block setup, call once before process()
+     * @return true if any of the tone controls are smoothing this block
+     */
+    bool prepareBlock()
     {
         bass_s.setTargetValue(*bass_p);
         mid_s.setTargetValue(*mid_p);
         treble_s.setTargetValue(*treble_p);
         pres_s.setTargetValue(*presence_p);
 
-        bool b = *bright_p;
-
         auto smoothers = getSmoothers();
-        int bitmask = 0;
+        smoothingMask = 0;
         for (int i = 0; i < smoothers.size(); ++i)
             if (smoothers[i]->isSmoothing())
-                bitmask |= 1 << i;
+                smoothingMask |= 1 << i;
 
-        if (bitmask > 0)
+        return smoothingMask > 0;
+    }
+
+    bool isBright() const { return *bright_p; }
+
+    template <bool Bright, bool Smoothing, typename Block>
+    void process(Block &block)
+    {
+        if constexpr (Smoothing)
         {
+            auto smoothers = getSmoothers();
             for (size_t ch = 0; ch < block.getNumChannels(); ++ch)
             {
                 auto *in = block.getChannelPointer(ch);
@@ -490,54 +561,52 @@ struct ToneSection
                     int bit = 1;
                     for (int n = 0; n < smoothers.size(); ++n)
                     {
-                        if (bit & bitmask)
+                        if (bit & smoothingMask)
                             updateFilter(bit, smoothers[n]->getNextValue());
-                        
+
                         bit <<= 1;
                         // doing it per-channel since we're using SIMD and will only run once...not the best
                     }
 
-                    in[i] = lowPass.processSample(in[i]);
-
-                    Type xHPF = highPass.processSample(in[i]);
-                    Type xBPF = bandPass.processSample(in[i]);
-                    in[i] = xHPF + xBPF;
-                    in[i] = bass.processSample(in[i]);
-                    in[i] = mid.processSample(in[i]);
-                    in[i] = treble.processSample(in[i]);
-                    in[i] = presence.processSample(in[i]);
-                    if (b)
-                        in[i] = brightShelf.processSample(in[i]);
+                    in[i] = processSample<Bright>(in[i]);
                 }
             }
-            return;
         }
-
-        for (size_t ch = 0; ch < block.getNumChannels(); ++ch)
+        else
         {
-            auto *in = block.getChannelPointer(ch);
-            for (size_t i = 0; i < block.getNumSamples(); ++i)
+            for (size_t ch = 0; ch < block.getNumChannels(); ++ch)
             {
-                in[i] = lowPass.processSample(in[i]);
-
-                Type xHPF = highPass.processSample(in[i]);
-                Type xBPF = bandPass.processSample(in[i]);
-                in[i] = xHPF + xBPF;
-                in[i] = bass.processSample(in[i]);
-                in[i] = mid.processSample(in[i]);
-                in[i] = treble.processSample(in[i]);
-                in[i] = presence.processSample(in[i]);
-                if (b)
-                    in[i] = brightShelf.processSample(in[i]);
+                auto *in = block.getChannelPointer(ch);
+                for (size_t i = 0; i < block.getNumSamples(); ++i)
+                    in[i] = processSample<Bright>(in[i]);
             }
         }
     }
 
 private:
+    template <bool Bright>
+    inline Type processSample(Type x)
+    {
+        x = lowPass.processSample(x);
+
+        Type xHPF = highPass.processSample(x);
+        Type xBPF = bandPass.processSample(x);
+        x = xHPF + xBPF;
+        x = bass.processSample(x);
+        x = mid.processSample(x);
+        x = treble.processSample(x);
+        x = presence.processSample(x);
+        if constexpr (Bright)
+            x = brightShelf.processSample(x);
+
+        return x;
+    }
+
     AudioProcessorValueTreeState &apvts;
     strix::FloatParameter *bass_p, *mid_p, *treble_p, *presence_p;
     strix::BoolParameter *bright_p, *legacy_p;
     double SR = 44100.0;
+    int smoothingMask = 0;
 };
 
 //========================================================
@@ -546,30 +615,54 @@ template <typename Type>
 class ClassBValvePair
 {
 public:
-    ClassBValvePair(strix::FloatParameter *outGain, strix::ChoiceParameter *chMode) : gain(outGain), channel(chMode)
+    ClassBValvePair(AmpState<Type> &state, strix::FloatParameter *outGain)
+        : dcRemoval(state.powerDCRemoval), gain(outGain)
     {
     }
 
-    void prepare(const dsp::ProcessSpec &spec) noexcept
+    void prepare(const AmpDesign &design) noexcept
     {
-        dcRemoval.prepare(spec);
-        dcRemoval.coefficients = (dsp::IIR::Coefficients<double>::makeHighPass(spec.sampleRate, 10.0));
+        dcRemoval.setCoefficients(design.powerDCRemoval);
     }
 
+    /* the gain smoother starts on the current master, so a reset engine doesn't glide from where it was */
     void reset()
     {
         dcRemoval.reset();
+        lastGain = blockGain = *gain;
     }
 
-    template <typename Block>
+    /* state outside the AmpState arena */
+    struct Checkpoint
+    {
+        float lastGain, blockGain;
+    };
+
+    void saveCheckpoint(Checkpoint &c) const
+    {
+        c.lastGain = lastGain;
+        c.blockGain = blockGain;
+    }
+
+    void restoreCheckpoint(const Checkpoint &c)
+    {
+        lastGain = c.lastGain;
+        blockGain = c.blockGain;
+    }
+
+    /* per-block setup, call once before process(); the gain holds for the whole block however it's split */
+    void prepareBlock() { blockGain = *gain; }
+
+    template <bool HiGain, typename Block>
     void process(Block &block)
     {
-        if (*channel)
-            for (size_t ch = 0; ch < block.getNumChannels(); ++ch)
-                processHiGain(block.getChannelPointer(ch), *gain, block.getNumSamples());
-        else
-            for (size_t ch = 0; ch < block.getNumChannels(); ++ch)
-                processLoGain(block.getChannelPointer(ch), *gain, block.getNumSamples());
+        for (size_t ch = 0; ch < block.getNumChannels(); ++ch)
+        {
+            if constexpr (HiGain)
+                processHiGain(block.getChannelPointer(ch), blockGain, block.getNumSamples());
+            else
+                processLoGain(block.getChannelPointer(ch), blockGain, block.getNumSamples());
+        }
     }
 
     inline void processHiGain(Type *in, float gain, int numSamples)
@@ -647,22 +740,11 @@ public:
     }
 
 private:
-    dsp::IIR::Filter<Type> dcRemoval;
+    Biquad<Type> &dcRemoval;
 
     strix::FloatParameter *gain = nullptr;
-    strix::ChoiceParameter *channel = nullptr;
 
-    float lastGain = 0.0;
-
-    inline double waveShaper(double xn, Type g, Type Ln, Type Lp)
-    {
-        Type yn = 0.0;
-        if (xn <= 0)
-            yn = (g * xn) / (1.0 - ((g * xn) / Ln));
-        else
-            yn = (g * xn) / (1.0 + ((g * xn) / Lp));
-        return yn;
-    }
+    float lastGain = 0.0, blockGain = 0.0;
 
     inline vec waveShaper(vec xn, Type g, Type Ln, Type Lp)
     {
@@ -681,57 +763,254 @@ class AmpProcessor
 
     AudioProcessorValueTreeState &vts;
 
+
+    StageProfiler *profiler = nullptr;
+    bool lastSmoothing = false;
+
+    AmpState<T> state;
+
 public:
     AmpProcessor(AudioProcessorValueTreeState &v) : vts(v),
-                                                    preAmp(static_cast<strix::FloatParameter *>(vts.getParameter("gain")), static_cast<strix::ChoiceParameter *>(vts.getParameter("mode")), static_cast<strix::ChoiceParameter *>(vts.getParameter("channel"))),
-                                                    eq(vts),
-                                                    powerAmp(static_cast<strix::FloatParameter*>(vts.getParameter("master")), static_cast<strix::ChoiceParameter*>(vts.getParameter("channel")))
+                                                    ts9(state),
+                                                    preAmp(state, static_cast<strix::FloatParameter *>(vts.getParameter("gain")), static_cast<strix::ChoiceParameter *>(vts.getParameter("mode"))),
+                                                    eq(vts, state),
+                                                    powerAmp(state, static_cast<strix::FloatParameter*>(vts.getParameter("master")))
     {
         inputGain = vts.getRawParameterValue("gain");
         outGain = vts.getRawParameterValue("master");
         tsXGain = vts.getRawParameterValue("tsXgain");
         channel = vts.getRawParameterValue("channel");
+
+        /* zero the arena's padding as well, so checkpoints of the same state are the same bytes */
+        std::memset((void *)&state, 0, sizeof(state));
+        new (&state) AmpState<T>();
     }
 
-    void prepare(const dsp::ProcessSpec &spec) noexcept
+    /**
+     * `design` is the fixed filters at spec.sampleRate, copied into the
+     * arena; the caller resolves it from DesignCache off the audio thread and
+     * keeps it alive. Neither locks nor allocates.
+     */
+    void prepare(const dsp::ProcessSpec &spec, const AmpDesign &design) noexcept
     {
-        ts9.prepare(spec);
-        preAmp.prepare(spec);
-        eq.prepare(spec);
-        powerAmp.prepare(spec);
+        jassert(design.sampleRate == spec.sampleRate);
+
+        ts9.prepare(design);
+        preAmp.prepare(spec, design);
+        eq.prepare(spec, design);
+        powerAmp.prepare(design);
 
         SR = spec.sampleRate;
     }
 
     void reset()
     {
-        ts9.reset();
+        ts9.reset(tsXGain->load());
         preAmp.reset();
         eq.reset();
         powerAmp.reset();
     }
 
+    /**
+     * Everything the engine carries from one sample to the next: the whole
+     * AmpState arena, including coefficients, plus each stage's smoothers and
+     * bookkeeping. Plain data, so it can be stored and copied as bytes; it's
+     * filled field by field, so padding zeroed beforehand stays zero and equal
+     * states are equal bytes.
+     */
+    struct Checkpoint
+    {
+        double sampleRate;
+        AmpState<T> state;
+        typename TS9<T>::Checkpoint ts9;
+        typename PreAmp<T>::Checkpoint preAmp;
+        typename ToneSection<T>::Checkpoint eq;
+        typename ClassBValvePair<T>::Checkpoint powerAmp;
+        bool lastSmoothing;
+    };
+
+    void saveCheckpoint(Checkpoint &c)
+    {
+        c.sampleRate = SR;
+        c.state = state;
+        ts9.saveCheckpoint(c.ts9);
+        preAmp.saveCheckpoint(c.preAmp);
+        eq.saveCheckpoint(c.eq);
+        powerAmp.saveCheckpoint(c.powerAmp);
+        c.lastSmoothing = lastSmoothing;
+    }
+
+    /* whether restoreCheckpoint() would take `c`, which is whether it was taken at this rate */
+    bool canRestore(const Checkpoint &c) const { return c.sampleRate == SR; }
+
+    /* false, leaving the engine as it was, unless canRestore() */
+    bool restoreCheckpoint(const Checkpoint &c)
+    {
+        if (!canRestore(c))
+            return false;
+
+        state = c.state;
+        ts9.restoreCheckpoint(c.ts9);
+        preAmp.restoreCheckpoint(c.preAmp);
+        eq.restoreCheckpoint(c.eq);
+        powerAmp.restoreCheckpoint(c.powerAmp);
+        lastSmoothing = c.lastSmoothing;
+        return true;
+    }
+
+    /**
+     * Lane `fromLane` of `from`'s filter state into lane `toLane` of this
+     * engine's, or zeros into it without `from`. Smoothers, coefficients and
+     * the rest of the engine are left alone. For batch engines moving a
+     * packed stream in or out (STRXAudioProcessor::gatherLanes).
+     */
+    void copyLane(const AmpProcessor *from, size_t fromLane, size_t toLane)
+    {
+        AmpState<T>::visitState(from != nullptr ? from->state : state, state, [&](const T &src, T &dst)
+        {
+            LaneBuffer::setLane(dst, toLane, from != nullptr ? LaneBuffer::getLane(src, fromLane) : 0.0);
+        });
+    }
+
+    /* stages add their time to `p` when set */
+    void setProfiler(StageProfiler *p) { profiler = p; }
+
+    /* bytes of filter state and coefficients in the engine's arena */
+    static constexpr size_t getStateSize() { return sizeof(AmpState<T>); }
+
+    /* total per-instance footprint of the engine, which owns no heap memory; its fixed design is shared */
+    size_t getMemoryFootprint() const { return sizeof(*this); }
+
+    /**
+     * Selects a kernel specialised for the current channel, bright, TS and
+     * smoothing state once per block, so the inner loops don't branch on them
+     */
     template <typename Block>
     inline void processAmp(Block &block)
     {
-        auto tsX = tsXGain->load();
+        const auto setup = prepareStages();
 
-        for (size_t ch = 0; ch < block.getNumChannels(); ++ch)
-        {
-            auto in = block.getChannelPointer(ch);
-            if (tsX > 0.f)
-                ts9.process(in, tsX, block.getNumSamples());
-        }
+        static constexpr auto kernels = makeKernels<Block, allStages>(std::make_index_sequence<numKernels>());
+        (this->*kernels[setup.kernel])(block, setup.tsX);
+    }
+
+    /* the per-block setup and kernel choice of processAmp(), for running its stages separately */
+    struct StageSetup
+    {
+        int kernel;
+        float tsX;
+    };
+
+    StageSetup prepareStages()
+    {
+        const auto tsX = tsXGain->load();
+
+        preAmp.prepareBlock();
+        const bool smoothing = eq.prepareBlock();
+        powerAmp.prepareBlock();
+
+        int index = 0;
+        if (channel->load() > 0.f)
+            index |= hiGainKernel;
+        if (eq.isBright())
+            index |= brightKernel;
+        if (tsX > 0.f)
+            index |= tsKernel;
+        if (smoothing)
+            index |= smoothingKernel;
+
+        lastSmoothing = smoothing;
+
+        return {index, tsX};
+    }
 
-        preAmp.process(block);
-        eq.process(block);
-        powerAmp.process(block);
+    /**
+     * TS9 and preamp, then tone stack and power amp, of a block set up by
+     * prepareStages(). Each may be run over consecutive pieces of the block,
+     * and the two halves on different threads, as long as each piece goes
+     * through the first before the second; the result is the same as
+     * processAmp() on the whole block.
+     */
+    template <typename Block>
+    void processPreStages(Block &block, const StageSetup &setup)
+    {
+        static constexpr auto kernels = makeKernels<Block, preStages>(std::make_index_sequence<numKernels>());
+        (this->*kernels[setup.kernel])(block, setup.tsX);
     }
 
+    template <typename Block>
+    void processPostStages(Block &block, const StageSetup &setup)
+    {
+        static constexpr auto kernels = makeKernels<Block, postStages>(std::make_index_sequence<numKernels>());
+        (this->*kernels[setup.kernel])(block, setup.tsX);
+    }
+
+    /* true if the last processAmp() was smoothing tone control changes */
+    bool isSmoothing() const { return lastSmoothing; }
+
     TS9<T> ts9;
     PreAmp<T> preAmp;
     ToneSection<T> eq;
     ClassBValvePair<T> powerAmp;
+
+private:
+    enum KernelFlags
+    {
+        hiGainKernel = 1,
+        brightKernel = 1 << 1,
+        tsKernel = 1 << 2,
+        smoothingKernel = 1 << 3,
+        numKernels = 1 << 4
+    };
+
+    enum StageGroups
+    {
+        preStages = 1,
+        postStages = 1 << 1,
+        allStages = preStages | postStages
+    };
+
+    template <typename Block, int Groups, bool HiGain, bool Bright, bool TSEnabled, bool Smoothing>
+    void processKernel(Block &block, float tsX)
+    {
+        if constexpr ((Groups & preStages) != 0)
+        {
+            if constexpr (TSEnabled)
+            {
+                const StageProfiler::Scope scope(profiler, StageProfiler::ts9);
+                for (size_t ch = 0; ch < block.getNumChannels(); ++ch)
+                    ts9.process(block.getChannelPointer(ch), tsX, block.getNumSamples());
+            }
+
+            const StageProfiler::Scope scope(profiler, StageProfiler::preAmp);
+            preAmp.template process<HiGain>(block);
+        }
+
+        if constexpr ((Groups & postStages) != 0)
+        {
+            {
+                const StageProfiler::Scope scope(profiler, StageProfiler::toneSection);
+                eq.template process<Bright, Smoothing>(block);
+            }
+
+            const StageProfiler::Scope scope(profiler, StageProfiler::powerAmp);
+            powerAmp.template process<HiGain>(block);
+        }
+    }
+
+    template <typename Block>
+    using Kernel = void (AmpProcessor::*)(Block &, float);
+
+    template <typename Block, int Groups, size_t... I>
+    static constexpr std::array<Kernel<Block>, sizeof...(I)> makeKernels(std::index_sequence<I...>)
+    {
+        return {{&AmpProcessor::processKernel<Block,
+                                              Groups,
+                                              (I & hiGainKernel) != 0,
+                                              (I & brightKernel) != 0,
+                                              (I & tsKernel) != 0,
+                                              (I & smoothingKernel) != 0>...}};
+    }
 };
 
 //=======================================================================
@@ -0,0 +1,231 @@
+// Telemetry.hpp
+
+#pragma once
+
+#if JUCE_LINUX || JUCE_MAC
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+/**
+ * Optional export of per-instance counters to a POSIX shared memory segment
+ * named /strx-<pid>-<instance>, so a collector on the same machine can read
+ * them from outside the host process. It's enabled by setting STRX_TELEMETRY
+ * in the host's environment and does nothing otherwise, or on Windows.
+ *
+ * The audio thread writes the counters under a sequence lock: it bumps the
+ * sequence to odd, stores the fields and bumps it to even. Writing never
+ * waits. A reader copies the fields and keeps the copy only if the sequence
+ * was the same even number before and after. The segment is unlinked when
+ * the instance goes away.
+ */
+class TelemetryPublisher : private AudioProcessorParameter::Listener
+{
+public:
+    static constexpr uint64 magic = 0x31544c4d58525453; // "STRXMLT1"
+    static constexpr uint32 version = 1;
+
+    /* the segment's layout; every field is a lock-free atomic, so it is address free across processes */
+    struct Segment
+    {
+        std::atomic<uint64> magic;
+        std::atomic<uint32> version, pid;
+        std::atomic<uint64> sequence;
+
+        /* seconds of audio per second of processing, smoothed */
+        std::atomic<double> realtimeFactor;
+        std::atomic<double> sampleRate;
+        std::atomic<uint64> blocks, samples, overruns;
+        /* the processor's quality index: 0 1x, 1 HQ, 2 render HQ, 3 auto, 6 fixed rate; and the factor actually running */
+        std::atomic<int32> oversamplingMode, oversamplingFactor;
+        /* parameter changes per second over the last second of audio, and all of them so far */
+        std::atomic<double> parameterEventRate;
+        std::atomic<uint64> parameterEvents;
+    };
+
+    struct Snapshot
+    {
+        uint32 pid = 0;
+        double realtimeFactor = 0.0, sampleRate = 0.0;
+        uint64 blocks = 0, samples = 0, overruns = 0;
+        int32 oversamplingMode = 0, oversamplingFactor = 1;
+        double parameterEventRate = 0.0;
+        uint64 parameterEvents = 0;
+    };
+
+    /* what the audio thread hands over once per callback */
+    struct Block
+    {
+        int64 ticks;
+        int numSamples;
+        double sampleRate;
+        bool overrun;
+        int oversamplingMode, oversamplingFactor;
+    };
+
+    explicit TelemetryPublisher(AudioProcessor &p) : processor(p)
+    {
+        if (SystemStats::getEnvironmentVariable("STRX_TELEMETRY", {}).isEmpty())
+            return;
+
+        open();
+
+        if (segment != nullptr)
+            for (auto *param : processor.getParameters())
+                param->addListener(this);
+    }
+
+    ~TelemetryPublisher() override
+    {
+        if (segment == nullptr)
+            return;
+
+        for (auto *param : processor.getParameters())
+            param->removeListener(this);
+
+        close();
+    }
+
+    bool isEnabled() const { return segment != nullptr; }
+
+    /* audio thread, once per callback; wait-free */
+    void publish(const Block &b)
+    {
+        if (segment == nullptr || b.numSamples <= 0 || b.sampleRate <= 0.0)
+            return;
+
+        const auto audioSeconds = (double)b.numSamples / b.sampleRate;
+        const auto cpuSeconds = Time::highResolutionTicksToSeconds(b.ticks);
+        if (cpuSeconds > 0.0)
+            realtimeFactor += (audioSeconds / cpuSeconds - realtimeFactor) * smoothing;
+
+        ++blocks;
+        samples += (uint64)b.numSamples;
+        overruns += b.overrun ? 1 : 0;
+
+        /* rate over windows of a second of audio */
+        const auto events = parameterEvents.load(std::memory_order_relaxed);
+        windowSeconds += audioSeconds;
+        if (windowSeconds >= 1.0)
+        {
+            eventRate = (double)(events - windowEvents) / windowSeconds;
+            windowEvents = events;
+            windowSeconds = 0.0;
+        }
+
+        auto &s = *segment;
+        const auto seq = s.sequence.load(std::memory_order_relaxed);
+        s.sequence.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        s.realtimeFactor.store(realtimeFactor, std::memory_order_relaxed);
+        s.sampleRate.store(b.sampleRate, std::memory_order_relaxed);
+        s.blocks.store(blocks, std::memory_order_relaxed);
+        s.samples.store(samples, std::memory_order_relaxed);
+        s.overruns.store(overruns, std::memory_order_relaxed);
+        s.oversamplingMode.store(b.oversamplingMode, std::memory_order_relaxed);
+        s.oversamplingFactor.store(b.oversamplingFactor, std::memory_order_relaxed);
+        s.parameterEventRate.store(eventRate, std::memory_order_relaxed);
+        s.parameterEvents.store(events, std::memory_order_relaxed);
+
+        s.sequence.store(seq + 2, std::memory_order_release);
+    }
+
+    /* collector side: a consistent copy of a mapped segment, or false if it isn't one of ours or the writer kept it busy */
+    static bool read(const Segment &s, Snapshot &out, int maxAttempts = 100)
+    {
+        if (s.magic.load(std::memory_order_acquire) != magic || s.version.load(std::memory_order_relaxed) != version)
+            return false;
+
+        for (int attempt = 0; attempt < maxAttempts; ++attempt)
+        {
+            const auto before = s.sequence.load(std::memory_order_acquire);
+            if (before & 1)
+                continue;
+
+            Snapshot snap;
+            snap.pid = s.pid.load(std::memory_order_relaxed);
+            snap.realtimeFactor = s.realtimeFactor.load(std::memory_order_relaxed);
+            snap.sampleRate = s.sampleRate.load(std::memory_order_relaxed);
+            snap.blocks = s.blocks.load(std::memory_order_relaxed);
+            snap.samples = s.samples.load(std::memory_order_relaxed);
+            snap.overruns = s.overruns.load(std::memory_order_relaxed);
+            snap.oversamplingMode = s.oversamplingMode.load(std::memory_order_relaxed);
+            snap.oversamplingFactor = s.oversamplingFactor.load(std::memory_order_relaxed);
+            snap.parameterEventRate = s.parameterEventRate.load(std::memory_order_relaxed);
+            snap.parameterEvents = s.parameterEvents.load(std::memory_order_relaxed);
+
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (s.sequence.load(std::memory_order_relaxed) == before)
+            {
+                out = snap;
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+private:
+    static_assert(std::atomic<uint64>::is_always_lock_free && std::atomic<double>::is_always_lock_free,
+                  "telemetry fields must be lock-free to live in shared memory");
+
+    static constexpr double smoothing = 0.05;
+
+    void parameterValueChanged(int, float) override { parameterEvents.fetch_add(1, std::memory_order_relaxed); }
+    void parameterGestureChanged(int, bool) override {}
+
+    void open()
+    {
+#if JUCE_LINUX || JUCE_MAC
+        static std::atomic<int> numInstances{0};
+        name = "/strx-" + String((int)getpid()) + "-" + String(numInstances++);
+
+        const auto fd = shm_open(name.toRawUTF8(), O_CREAT | O_RDWR | O_TRUNC, 0644);
+        if (fd < 0)
+            return;
+
+        void *mem = MAP_FAILED;
+        if (ftruncate(fd, (off_t)sizeof(Segment)) == 0)
+            mem = mmap(nullptr, sizeof(Segment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd);
+
+        if (mem == MAP_FAILED)
+        {
+            shm_unlink(name.toRawUTF8());
+            return;
+        }
+
+        segment = new (mem) Segment{};
+        segment->pid.store((uint32)getpid(), std::memory_order_relaxed);
+        segment->version.store(version, std::memory_order_relaxed);
+        /* last, so a collector never takes a half set up segment for a live one */
+        segment->magic.store(magic, std::memory_order_release);
+#endif
+    }
+
+    void close()
+    {
+#if JUCE_LINUX || JUCE_MAC
+        segment->magic.store(0, std::memory_order_release);
+        munmap(segment, sizeof(Segment));
+        shm_unlink(name.toRawUTF8());
+        segment = nullptr;
+#endif
+    }
+
+    AudioProcessor &processor;
+    String name;
+    Segment *segment = nullptr;
+
+    std::atomic<uint64> parameterEvents{0};
+
+    /* audio thread */
+    double realtimeFactor = 0.0;
+    uint64 blocks = 0, samples = 0, overruns = 0;
+    uint64 windowEvents = 0;
+    double windowSeconds = 0.0, eventRate = 0.0;
+
+    JUCE_DECLARE_NON_COPYABLE(TelemetryPublisher)
+};
@@ -0,0 +1,201 @@
+// WorkStealingPool.hpp
+
+#pragma once
+
+/**
+ * Fixed set of worker threads, each with its own task deque. A task is queued
+ * on a home worker, which is the one woken for it and runs its own tasks
+ * newest first while they're warm in its cache. A worker that runs dry only
+ * steals from one with a backlog, taking its oldest task and leaving it the
+ * last, and an idle worker is only woken to steal once a backlog builds. So
+ * work with a stable home (one engine per home) keeps running on the same
+ * thread unless the load is uneven.
+ *
+ * Not for the audio thread: submitting allocates and takes a lock.
+ */
+class WorkStealingPool
+{
+public:
+    using Task = std::function<void()>;
+
+    /* 0 for one worker per physical core */
+    explicit WorkStealingPool(int numWorkers = 0)
+    {
+        if (numWorkers <= 0)
+            numWorkers = jmax(1, SystemStats::getNumPhysicalCpus());
+
+        for (int i = 0; i < numWorkers; ++i)
+            workers.push_back(std::make_unique<Worker>());
+
+        for (int i = 0; i < numWorkers; ++i)
+            workers[(size_t)i]->thread = std::thread([this, i] { run(i); });
+    }
+
+    ~WorkStealingPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(sleepLock);
+            quit = true;
+            for (auto &w : workers)
+                w->wake.notify_all();
+        }
+
+        for (auto &w : workers)
+            w->thread.join();
+    }
+
+    int getNumWorkers() const { return (int)workers.size(); }
+
+    /* queue a task on a home worker, taken modulo the number of workers */
+    void submit(int home, Task task)
+    {
+        {
+            std::lock_guard<std::mutex> lock(sleepLock);
+            ++pending;
+        }
+
+        auto &w = *workers[(size_t)home % workers.size()];
+        {
+            std::lock_guard<std::mutex> lock(w.lock);
+            w.tasks.push_back(std::move(task));
+            ++w.queued;
+        }
+
+        /* the home worker, then a sleeping one to steal if the home worker has more than it can start on */
+        std::lock_guard<std::mutex> lock(sleepLock);
+        w.wake.notify_one();
+
+        if (w.queued.load() > 1)
+            for (auto &other : workers)
+                if (other.get() != &w && other->sleeping)
+                {
+                    other->sleeping = false;
+                    other->wake.notify_one();
+                    break;
+                }
+    }
+
+    /* block until every task submitted so far has run; the caller steals work while it waits */
+    void wait()
+    {
+        Task task;
+        while (pending.load() > 0)
+        {
+            if (steal(-1, task))
+                runTask(task);
+            else
+            {
+                std::unique_lock<std::mutex> lock(sleepLock);
+                done.wait(lock, [this] { return pending.load() == 0 || hasBacklog(); });
+            }
+        }
+    }
+
+private:
+    struct Worker
+    {
+        std::mutex lock;
+        std::deque<Task> tasks;
+        /* tasks.size(), readable without the lock */
+        std::atomic<int> queued{0};
+        std::thread thread;
+
+        /* under sleepLock */
+        std::condition_variable wake;
+        bool sleeping = false;
+    };
+
+    void run(int index)
+    {
+        Task task;
+        for (;;)
+        {
+            if (popOwn(index, task) || steal(index, task))
+            {
+                runTask(task);
+                continue;
+            }
+
+            auto &w = *workers[(size_t)index];
+            std::unique_lock<std::mutex> lock(sleepLock);
+            w.sleeping = true;
+            w.wake.wait(lock, [this, &w] { return quit || w.queued.load() > 0 || hasBacklog(); });
+            w.sleeping = false;
+            if (quit)
+                return;
+        }
+    }
+
+    void runTask(Task &task)
+    {
+        task();
+        task = nullptr;
+
+        bool finished;
+        {
+            std::lock_guard<std::mutex> lock(sleepLock);
+            finished = --pending == 0;
+        }
+        if (finished)
+            done.notify_all();
+    }
+
+    bool popOwn(int index, Task &task)
+    {
+        auto &w = *workers[(size_t)index];
+        std::lock_guard<std::mutex> lock(w.lock);
+        if (w.tasks.empty())
+            return false;
+
+        task = std::move(w.tasks.back());
+        w.tasks.pop_back();
+        --w.queued;
+        return true;
+    }
+
+    /* oldest task of the first other worker with a backlog, starting after the thief */
+    bool steal(int thief, Task &task)
+    {
+        const auto n = (int)workers.size();
+        for (int i = 1; i <= n; ++i)
+        {
+            const auto victim = (thief + i + n) % n;
+            if (victim == thief)
+                continue;
+
+            auto &w = *workers[(size_t)victim];
+            if (w.queued.load() < 2)
+                continue;
+
+            std::lock_guard<std::mutex> lock(w.lock);
+            if (w.tasks.size() < 2)
+                continue;
+
+            task = std::move(w.tasks.front());
+            w.tasks.pop_front();
+            --w.queued;
+            return true;
+        }
+
+        return false;
+    }
+
+    /* whether any worker has more queued than the one it will start on next, which others may steal */
+    bool hasBacklog() const
+    {
+        for (auto &w : workers)
+            if (w->queued.load() > 1)
+                return true;
+        return false;
+    }
+
+    std::vector<std::unique_ptr<Worker>> workers;
+
+    /* pending counts tasks submitted and not finished */
+    std::mutex sleepLock;
+    std::condition_variable done;
+    std::atomic<int> pending{0};
+    bool quit = false;
+
+    JUCE_DECLARE_NON_COPYABLE(WorkStealingPool)
+};
@@ -0,0 +1,180 @@
+// Alias.cpp
+// Aliasing against CPU for every quality mode, at each sample rate:
+//   strx_alias [sample rate ...]
+// Drives the whole processor (cabinet and gate off) with bin-centred sines
+// from 2 kHz up, at each gain setting, and measures the energy between the
+// harmonics of each sine, 20 Hz to 20 kHz, against the energy in them.
+// Reported per mode as the average and worst of that ratio over the test
+// frequencies, with the processing cost as a share of real time. Renders run
+// one at a time, so the CPU figures are for a single core.
+
+#include <JuceHeader.h>
+#include "EnginePool.hpp"
+#include "Analysis.hpp"
+
+#include <iostream>
+
+struct Mode
+{
+    const char *name;
+    EnginePool::Parameters parameters;
+};
+
+/* every quality the processor offers; a new mode only needs an entry here */
+static const std::vector<Mode> &getModes()
+{
+    static const std::vector<Mode> modes{
+        {"1x", {{"hq", 0.f}, {"renderHQ", 0.f}, {"autoHQ", 0.f}, {"fixedRate", 0.f}}},
+        {"HQ", {{"hq", 1.f}, {"renderHQ", 0.f}, {"autoHQ", 0.f}, {"fixedRate", 0.f}}},
+        {"render HQ", {{"hq", 0.f}, {"renderHQ", 1.f}, {"autoHQ", 0.f}, {"fixedRate", 0.f}}},
+        {"auto", {{"hq", 0.f}, {"renderHQ", 0.f}, {"autoHQ", 1.f}, {"fixedRate", 0.f}}},
+        {"fixed rate", {{"hq", 0.f}, {"renderHQ", 0.f}, {"autoHQ", 0.f}, {"fixedRate", 1.f}}}};
+    return modes;
+}
+
+static constexpr float drives[] = {2.f, 5.f, 8.f, 10.f};
+static constexpr int numFrequencies = 8;
+static constexpr double lowestFrequency = 2000.0, highestFrequency = 18000.0;
+static constexpr double amplitude = 0.5;
+
+static constexpr int fftOrder = 14;
+/* bins either side of a harmonic counted as part of it */
+static constexpr int harmonicWidth = 2;
+
+struct Measurement
+{
+    /* inharmonic over harmonic energy, dB */
+    double aliasing = 0.0;
+    double cpuSeconds = 0.0, audioSeconds = 0.0;
+};
+
+/* the sine's frequency lands on an odd bin, so its aliases land on bins between its harmonics */
+static double getTestFrequency(double target, double sampleRate)
+{
+    const auto binWidth = sampleRate / (double)(1 << fftOrder);
+    auto bin = (int)std::round(target / binWidth);
+    bin |= 1;
+    return bin * binWidth;
+}
+
+static Measurement measure(EnginePool &pool, double sampleRate, const Mode &mode, float drive, double frequency)
+{
+    auto parameters = mode.parameters;
+    parameters.emplace_back("gain", drive);
+    parameters.emplace_back("cab", 0.f);
+
+    String error;
+    auto engine = pool.acquire(sampleRate, 1, parameters, error);
+    jassert(engine != nullptr);
+
+    const auto fftSize = 1 << fftOrder;
+    /* a fifth of a second for the filters to settle, then three overlapping frames */
+    const auto skip = (int)(0.2 * sampleRate);
+    const auto total = skip + 2 * fftSize;
+    const auto blockSize = pool.getMaxBlockSize();
+
+    std::vector<float> out((size_t)total);
+    AudioBuffer<double> block(1, blockSize);
+    MidiBuffer midi;
+    const auto phaseStep = MathConstants<double>::twoPi * frequency / sampleRate;
+
+    int64 ticks = 0;
+    for (int pos = 0; pos < total; pos += blockSize)
+    {
+        const auto n = jmin(blockSize, total - pos);
+        for (int i = 0; i < n; ++i)
+            block.setSample(0, i, amplitude * std::sin(phaseStep * (double)(pos + i)));
+
+        AudioBuffer<double> sub(block.getArrayOfWritePointers(), 1, n);
+        const auto start = Time::getHighResolutionTicks();
+        engine->processBlock(sub, midi);
+        ticks += Time::getHighResolutionTicks() - start;
+
+        for (int i = 0; i < n; ++i)
+            out[(size_t)(pos + i)] = (float)block.getSample(0, i);
+    }
+
+    pool.release(std::move(engine));
+
+    const auto power = getAveragePowerSpectrum(out.data() + skip, (size_t)(total - skip), fftOrder);
+    const auto binWidth = sampleRate / (double)fftSize;
+
+    std::vector<bool> harmonic(power.size(), false);
+    for (int b = 0; b <= harmonicWidth; ++b)
+        harmonic[(size_t)b] = true;
+    for (auto f = frequency; f < sampleRate * 0.5; f += frequency)
+    {
+        const auto centre = (int)std::round(f / binWidth);
+        for (int b = jmax(0, centre - harmonicWidth); b <= jmin((int)power.size() - 1, centre + harmonicWidth); ++b)
+            harmonic[(size_t)b] = true;
+    }
+
+    double harmonicEnergy = 1.0e-30, inharmonicEnergy = 1.0e-30;
+    for (size_t b = 0; b < power.size(); ++b)
+    {
+        const auto f = getBinFrequency(b, fftOrder, sampleRate);
+        if (harmonic[b])
+            harmonicEnergy += power[b];
+        else if (f >= 20.0 && f <= 20000.0)
+            inharmonicEnergy += power[b];
+    }
+
+    Measurement m;
+    m.aliasing = 10.0 * std::log10(inharmonicEnergy / harmonicEnergy);
+    m.cpuSeconds = Time::highResolutionTicksToSeconds(ticks);
+    m.audioSeconds = total / sampleRate;
+    return m;
+}
+
+int main(int argc, char *argv[])
+{
+    const ScopedJuceInitialiser_GUI juceInit;
+
+    std::vector<double> sampleRates;
+    for (int i = 1; i < argc; ++i)
+        sampleRates.push_back(String(argv[i]).getDoubleValue());
+    if (sampleRates.empty())
+        sampleRates = {44100.0, 48000.0, 96000.0, 192000.0};
+
+    EnginePool pool;
+
+    for (auto sampleRate : sampleRates)
+    {
+        const auto top = jmin(highestFrequency, 0.4 * sampleRate);
+
+        std::cout << "\n" << String(sampleRate, 0) << " Hz, " << numFrequencies << " sines from " << lowestFrequency << " to "
+                  << String(top, 0) << " Hz; aliasing in dB below the harmonics, average / worst\n";
+
+        auto heading = String("mode").paddedRight(' ', 10) + String("cpu %").paddedLeft(' ', 9);
+        for (auto drive : drives)
+            heading << ("gain " + String(drive, 0)).paddedLeft(' ', 15);
+        std::cout << heading << "\n";
+
+        for (auto &mode : getModes())
+        {
+            double cpu = 0.0, audio = 0.0;
+            String row;
+
+            for (auto drive : drives)
+            {
+                double sum = 0.0, worst = -1000.0;
+                for (int k = 0; k < numFrequencies; ++k)
+                {
+                    const auto target = lowestFrequency * std::pow(top / lowestFrequency, (double)k / (numFrequencies - 1));
+                    const auto m = measure(pool, sampleRate, mode, drive, getTestFrequency(target, sampleRate));
+
+                    sum += m.aliasing;
+                    worst = jmax(worst, m.aliasing);
+                    cpu += m.cpuSeconds;
+                    audio += m.audioSeconds;
+                }
+
+                row << (String(sum / numFrequencies, 1) + " / " + String(worst, 1)).paddedLeft(' ', 15);
+            }
+
+            std::cout << String(mode.name).paddedRight(' ', 10) << String(cpu / audio * 100.0, 2).paddedLeft(' ', 9) << row << "\n";
+        }
+    }
+
+    return 0;
+}
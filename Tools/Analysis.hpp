@@ -0,0 +1,59 @@
+// Analysis.hpp
+// Spectral measurements shared by the analysis tools
+
+#pragma once
+
+/**
+ * Power per bin, 0 to fftSize / 2, averaged over Hann-windowed frames with
+ * half a frame of overlap (Welch's method). The window is scaled so a full
+ * scale sine centred on a bin measures 1 in that bin.
+ */
+static std::vector<double> getAveragePowerSpectrum(const float *x, size_t numSamples, int fftOrder)
+{
+    const auto size = (size_t)1 << fftOrder;
+    const auto numBins = size / 2 + 1;
+    std::vector<double> power(numBins, 0.0);
+    if (numSamples < size)
+        return power;
+
+    std::vector<float> window(size);
+    double windowSum = 0.0;
+    for (size_t i = 0; i < size; ++i)
+    {
+        window[i] = (float)(0.5 - 0.5 * std::cos(MathConstants<double>::twoPi * (double)i / (double)size));
+        windowSum += window[i];
+    }
+
+    dsp::FFT fft(fftOrder);
+    std::vector<float> frame(size * 2);
+    int numFrames = 0;
+
+    for (size_t start = 0; start + size <= numSamples; start += size / 2)
+    {
+        std::fill(frame.begin(), frame.end(), 0.f);
+        for (size_t i = 0; i < size; ++i)
+            frame[i] = x[start + i] * window[i];
+
+        fft.performRealOnlyForwardTransform(frame.data(), true);
+
+        for (size_t b = 0; b < numBins; ++b)
+        {
+            const double re = frame[2 * b], im = frame[2 * b + 1];
+            power[b] += re * re + im * im;
+        }
+        ++numFrames;
+    }
+
+    /* amplitude A centred on a bin gives A * windowSum / 2 */
+    const auto scale = 4.0 / (windowSum * windowSum * numFrames);
+    for (auto &p : power)
+        p *= scale;
+
+    return power;
+}
+
+/* centre frequency of bin b */
+static double getBinFrequency(size_t b, int fftOrder, double sampleRate)
+{
+    return (double)b * sampleRate / (double)((size_t)1 << fftOrder);
+}
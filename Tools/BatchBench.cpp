@@ -0,0 +1,73 @@
+// BatchBench.cpp
+// Throughput of the batch engine against thread count:
+//   strx_batch_bench [streams] [seconds] [block size] [pack]
+// "pack" runs mono streams with matching settings lane-packed
+
+#include <JuceHeader.h>
+#include "BatchEngine.hpp"
+
+#include <iostream>
+
+/* seconds of audio per second of wall time, all streams together */
+static double measure(int numThreads, int numStreams, double seconds, int blockSize, double sampleRate, bool pack)
+{
+    BatchEngine engine(numThreads);
+    engine.setLanePacking(pack);
+    for (int i = 0; i < numStreams; ++i)
+    {
+        engine.addStream();
+        engine.setParameter(i, "gain", 3.f + (float)(i % 7));
+    }
+    engine.prepare(sampleRate, blockSize);
+
+    Random random(1);
+    for (int i = 0; i < numStreams; ++i)
+    {
+        auto &buffer = engine.getBuffer(i);
+        for (int ch = 0; ch < buffer.getNumChannels(); ++ch)
+            for (int n = 0; n < blockSize; ++n)
+                buffer.setSample(ch, n, random.nextDouble() * 0.5 - 0.25);
+    }
+
+    /* let the first blocks settle parameter changes and quality builds before timing */
+    for (int b = 0; b < 8; ++b)
+        engine.process(blockSize);
+
+    const auto numBlocks = (int)std::ceil(seconds * sampleRate / blockSize);
+    const auto start = Time::getHighResolutionTicks();
+    for (int b = 0; b < numBlocks; ++b)
+        engine.process(blockSize);
+    const auto elapsed = Time::highResolutionTicksToSeconds(Time::getHighResolutionTicks() - start);
+
+    return (double)numBlocks * blockSize / sampleRate * numStreams / elapsed;
+}
+
+int main(int argc, char *argv[])
+{
+    const ScopedJuceInitialiser_GUI juceInit;
+
+    const auto numStreams = argc > 1 ? String(argv[1]).getIntValue() : 64;
+    const auto seconds = argc > 2 ? String(argv[2]).getDoubleValue() : 10.0;
+    const auto blockSize = argc > 3 ? String(argv[3]).getIntValue() : 512;
+    const auto pack = argc > 4 && String(argv[4]) == "pack";
+    const auto sampleRate = 48000.0;
+
+    std::cout << numStreams << " streams, " << seconds << " s each, " << blockSize << " sample blocks"
+              << (pack ? ", lane packed" : "") << "\n";
+    std::cout << "threads  realtime x  speedup  efficiency\n";
+
+    double single = 0.0;
+    const auto maxThreads = SystemStats::getNumCpus();
+    for (int threads = 1; threads <= maxThreads; threads = threads < maxThreads ? jmin(threads * 2, maxThreads) : threads + 1)
+    {
+        const auto rate = measure(threads, numStreams, seconds, blockSize, sampleRate, pack);
+        if (threads == 1)
+            single = rate;
+
+        const auto speedup = rate / single;
+        std::cout << String(threads).paddedLeft(' ', 7) << String(rate, 1).paddedLeft(' ', 12)
+                  << String(speedup, 2).paddedLeft(' ', 9) << String(speedup / threads * 100.0, 0).paddedLeft(' ', 11) << "%\n";
+    }
+
+    return 0;
+}
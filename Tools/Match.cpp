@@ -0,0 +1,327 @@
+// Match.cpp
+// Settings that come closest to a reference recording of a DI:
+//   strx_match <di> <reference> [id=value ...] [--seconds s] [--keep n] [--top n]
+// Fixed parameters (e.g. cab=1) apply to every candidate. Distance is the RMS
+// difference in dB of the level-matched long-term spectra in sixth-octave
+// bands, so it ignores output level and timing.
+//
+// The search runs a coarse grid over gain, mode, bass, mid, treble, presence,
+// master and channel, then refines the best `keep` candidates by a pattern
+// search with halving steps. Both run at 1x, with no oversampling; the best
+// `top` are scored again at render quality (renderHQ unless fixed otherwise)
+// and reported.
+
+#include <JuceHeader.h>
+#include "EnginePool.hpp"
+#include "WorkStealingPool.hpp"
+#include "Analysis.hpp"
+
+#include <iostream>
+
+static constexpr int fftOrder = 12;
+/* output skipped before analysis, while the gate and smoothing come up */
+static constexpr double settleSeconds = 0.25;
+static constexpr double lowestBand = 60.0, highestBand = 16000.0;
+
+/* the continuous parameters searched, all in their 0 to 1 normalised range */
+static const char *const searchIDs[] = {"gain", "bass", "mid", "treble", "presence", "master"};
+static constexpr int numSearch = 6;
+static constexpr int numModes = 3, numChannels = 2;
+
+struct Candidate
+{
+    std::array<float, numSearch> values{};
+    int mode = 1, channel = 1;
+    double distance = std::numeric_limits<double>::max();
+};
+
+/* dB per sixth-octave band, minus the mean over the bands */
+static std::vector<double> getBandProfile(const float *x, size_t numSamples, double sampleRate)
+{
+    const auto power = getAveragePowerSpectrum(x, numSamples, fftOrder);
+    const auto top = jmin(highestBand, 0.45 * sampleRate);
+
+    std::vector<double> bands;
+    for (auto low = lowestBand; low < top; low *= std::pow(2.0, 1.0 / 6.0))
+    {
+        const auto high = low * std::pow(2.0, 1.0 / 6.0);
+        double sum = 1.0e-20;
+        for (size_t b = 0; b < power.size(); ++b)
+        {
+            const auto f = getBinFrequency(b, fftOrder, sampleRate);
+            if (f >= low && f < high)
+                sum += power[b];
+        }
+        bands.push_back(10.0 * std::log10(sum));
+    }
+
+    double mean = 0.0;
+    for (auto b : bands)
+        mean += b;
+    mean /= (double)jmax((size_t)1, bands.size());
+
+    for (auto &b : bands)
+        b -= mean;
+
+    return bands;
+}
+
+static double getDistance(const std::vector<double> &a, const std::vector<double> &b)
+{
+    double sum = 0.0;
+    for (size_t i = 0; i < a.size(); ++i)
+        sum += (a[i] - b[i]) * (a[i] - b[i]);
+    return std::sqrt(sum / (double)jmax((size_t)1, a.size()));
+}
+
+/* mono mix of the first `maxSamples` of a file, empty if it can't be read */
+static std::vector<float> readMono(const File &file, int64 maxSamples, double &sampleRate)
+{
+    AudioFormatManager formats;
+    formats.registerBasicFormats();
+    std::unique_ptr<AudioFormatReader> reader(formats.createReaderFor(file));
+    if (reader == nullptr)
+        return {};
+
+    sampleRate = reader->sampleRate;
+    const auto n = (int)jmin(reader->lengthInSamples, maxSamples);
+    AudioBuffer<float> buffer((int)reader->numChannels, n);
+    reader->read(&buffer, 0, n, 0, true, true);
+
+    std::vector<float> mono((size_t)n, 0.f);
+    for (int ch = 0; ch < buffer.getNumChannels(); ++ch)
+        FloatVectorOperations::addWithMultiply(mono.data(), buffer.getReadPointer(ch), 1.f / (float)buffer.getNumChannels(), n);
+
+    return mono;
+}
+
+class Matcher
+{
+public:
+    Matcher(std::vector<float> diToUse, std::vector<double> targetToUse, double sampleRateToUse, EnginePool::Parameters fixedToUse)
+        : di(std::move(diToUse)), target(std::move(targetToUse)), sampleRate(sampleRateToUse), fixed(std::move(fixedToUse))
+    {
+    }
+
+    /* score every candidate in parallel, at 1x or at the fixed render quality */
+    void evaluate(std::vector<Candidate> &candidates, bool renderQuality)
+    {
+        for (size_t i = 0; i < candidates.size(); ++i)
+            workers.submit((int)i, [this, &c = candidates[i], renderQuality] { c.distance = score(c, renderQuality); });
+        workers.wait();
+
+        numEvaluations += (int)candidates.size();
+    }
+
+    int getNumEvaluations() const { return numEvaluations; }
+
+    bool hasParameter(const String &id) const { return ranges.apvts.getParameter(id) != nullptr; }
+
+    EnginePool::Parameters getParameters(const Candidate &c) const
+    {
+        EnginePool::Parameters p;
+        for (int i = 0; i < numSearch; ++i)
+            p.emplace_back(searchIDs[i], ranges.apvts.getParameter(searchIDs[i])->convertFrom0to1(c.values[(size_t)i]));
+        p.emplace_back("mode", (float)c.mode);
+        p.emplace_back("channel", (float)c.channel);
+        return p;
+    }
+
+private:
+    double score(const Candidate &c, bool renderQuality)
+    {
+        auto parameters = getParameters(c);
+        if (renderQuality)
+            parameters.emplace_back("renderHQ", 1.f);
+        parameters.insert(parameters.end(), fixed.begin(), fixed.end());
+        if (!renderQuality)
+            for (auto *id : {"hq", "renderHQ", "autoHQ", "fixedRate"})
+                parameters.emplace_back(id, 0.f);
+
+        String error;
+        auto engine = engines.acquire(sampleRate, 1, parameters, error);
+        if (engine == nullptr)
+            return std::numeric_limits<double>::max();
+
+        const auto blockSize = engines.getMaxBlockSize();
+        AudioBuffer<double> block(1, blockSize);
+        std::vector<float> out(di.size());
+        MidiBuffer midi;
+
+        for (size_t pos = 0; pos < di.size(); pos += (size_t)blockSize)
+        {
+            const auto n = (int)jmin((size_t)blockSize, di.size() - pos);
+            for (int i = 0; i < n; ++i)
+                block.setSample(0, i, (double)di[pos + (size_t)i]);
+
+            AudioBuffer<double> sub(block.getArrayOfWritePointers(), 1, n);
+            engine->processBlock(sub, midi);
+
+            for (int i = 0; i < n; ++i)
+                out[pos + (size_t)i] = (float)block.getSample(0, i);
+        }
+
+        engines.release(std::move(engine));
+
+        const auto skip = jmin(out.size(), (size_t)(settleSeconds * sampleRate));
+        return getDistance(getBandProfile(out.data() + skip, out.size() - skip, sampleRate), target);
+    }
+
+    const std::vector<float> di;
+    const std::vector<double> target;
+    const double sampleRate;
+    const EnginePool::Parameters fixed;
+
+    /* for the parameters' ranges only */
+    STRXAudioProcessor ranges;
+
+    EnginePool engines{1024};
+    WorkStealingPool workers;
+    int numEvaluations = 0;
+};
+
+static void sortByDistance(std::vector<Candidate> &candidates)
+{
+    std::stable_sort(candidates.begin(), candidates.end(), [](const Candidate &a, const Candidate &b) { return a.distance < b.distance; });
+}
+
+/* three levels of every searched parameter, for every mode and channel */
+static std::vector<Candidate> makeGrid()
+{
+    static constexpr float levels[] = {1.f / 6.f, 0.5f, 5.f / 6.f};
+
+    std::vector<Candidate> grid;
+    for (int mode = 0; mode < numModes; ++mode)
+        for (int channel = 0; channel < numChannels; ++channel)
+            for (int index = 0; index < 729; ++index) // 3^numSearch
+            {
+                Candidate c;
+                c.mode = mode;
+                c.channel = channel;
+                for (int i = 0, rest = index; i < numSearch; ++i, rest /= 3)
+                    c.values[(size_t)i] = levels[rest % 3];
+                grid.push_back(c);
+            }
+
+    return grid;
+}
+
+/* from each candidate, try a step either way along every parameter and move to the best, if it's better */
+static void refine(Matcher &matcher, std::vector<Candidate> &best, float step)
+{
+    std::vector<Candidate> probes;
+    for (auto &c : best)
+        for (int i = 0; i < numSearch; ++i)
+            for (auto direction : {-1.f, 1.f})
+            {
+                auto probe = c;
+                probe.values[(size_t)i] = jlimit(0.f, 1.f, c.values[(size_t)i] + direction * step);
+                probes.push_back(probe);
+            }
+
+    matcher.evaluate(probes, false);
+
+    const auto perCandidate = (size_t)numSearch * 2;
+    for (size_t k = 0; k < best.size(); ++k)
+        for (size_t p = k * perCandidate; p < (k + 1) * perCandidate; ++p)
+            if (probes[p].distance < best[k].distance)
+                best[k] = probes[p];
+}
+
+int main(int argc, char *argv[])
+{
+    const ScopedJuceInitialiser_GUI juceInit;
+
+    if (argc < 3)
+    {
+        std::cout << "usage: strx_match <di> <reference> [id=value ...] [--seconds s] [--keep n] [--top n]\n";
+        return 1;
+    }
+
+    double seconds = 10.0;
+    int keep = 16, top = 5;
+    EnginePool::Parameters fixed;
+
+    for (int i = 3; i < argc; ++i)
+    {
+        const String arg(argv[i]);
+        if (arg == "--seconds" && i + 1 < argc)
+            seconds = String(argv[++i]).getDoubleValue();
+        else if (arg == "--keep" && i + 1 < argc)
+            keep = jmax(1, String(argv[++i]).getIntValue());
+        else if (arg == "--top" && i + 1 < argc)
+            top = jmax(1, String(argv[++i]).getIntValue());
+        else if (arg.contains("="))
+            fixed.emplace_back(arg.upToFirstOccurrenceOf("=", false, false), arg.fromFirstOccurrenceOf("=", false, false).getFloatValue());
+        else
+        {
+            std::cout << "unknown option " << arg << "\n";
+            return 1;
+        }
+    }
+
+    const auto cwd = File::getCurrentWorkingDirectory();
+    double diRate = 0.0, referenceRate = 0.0;
+    const auto maxSamples = (int64)(seconds * 192000.0);
+    auto di = readMono(cwd.getChildFile(argv[1]), maxSamples, diRate);
+    const auto reference = readMono(cwd.getChildFile(argv[2]), maxSamples, referenceRate);
+
+    if (di.empty() || reference.empty() || diRate != referenceRate)
+    {
+        std::cout << "need a readable DI and reference at the same sample rate\n";
+        return 1;
+    }
+
+    di.resize(jmin(di.size(), (size_t)(seconds * diRate)));
+
+    /* both are analysed over their common length, after the settling time, and need at least one FFT frame of that */
+    const auto length = jmin(reference.size(), di.size());
+    const auto skip = (size_t)(settleSeconds * diRate);
+    if (length < skip + ((size_t)1 << fftOrder))
+    {
+        std::cout << "need at least " << String(settleSeconds + (double)(1 << fftOrder) / diRate, 2) << " s of DI and reference\n";
+        return 1;
+    }
+
+    Matcher matcher(di, getBandProfile(reference.data() + skip, length - skip, diRate), diRate, fixed);
+
+    for (auto &[id, value] : fixed)
+        if (!matcher.hasParameter(id))
+        {
+            std::cout << "unknown parameter " << id << "\n";
+            return 1;
+        }
+
+    const auto start = Time::getMillisecondCounterHiRes();
+
+    auto candidates = makeGrid();
+    std::cout << "coarse: " << (int)candidates.size() << " candidates at 1x\n";
+    matcher.evaluate(candidates, false);
+    sortByDistance(candidates);
+    candidates.resize(jmin(candidates.size(), (size_t)keep));
+
+    for (auto step = 1.f / 6.f; step > 0.01f; step *= 0.5f)
+    {
+        std::cout << "refine: step " << String(step, 3) << ", best " << String(candidates.front().distance, 2) << " dB\n";
+        refine(matcher, candidates, step);
+        sortByDistance(candidates);
+    }
+
+    candidates.resize(jmin(candidates.size(), (size_t)top));
+    matcher.evaluate(candidates, true);
+    sortByDistance(candidates);
+
+    std::cout << matcher.getNumEvaluations() << " renders in " << String((Time::getMillisecondCounterHiRes() - start) / 1000.0, 1) << " s\n\n";
+    std::cout << "distance  settings\n";
+
+    for (auto &c : candidates)
+    {
+        String settings;
+        for (auto &[id, value] : matcher.getParameters(c))
+            settings << id << "=" << String(value, 1) << " ";
+
+        std::cout << (String(c.distance, 2) + " dB").paddedLeft(' ', 8) << "  " << settings << "\n";
+    }
+
+    return 0;
+}
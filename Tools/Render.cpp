@@ -0,0 +1,200 @@
+// Render.cpp
+// Offline reamp of an audio file, through the render cache by default:
+//   strx_render <input> <output.wav> [id=value ...] [--no-cache] [--pipeline [--verify]]
+// Parameters take their real values, e.g. gain=6.5 hq=1 cab=0. The output is
+// delayed by the processor's latency, as in a host without compensation.
+// --pipeline processes whole chunks with pipelined rendering; --verify also
+// renders them serially in the same blocks and fails unless every output
+// sample matches to the bit. Verifying renders without the cache.
+
+#include <JuceHeader.h>
+#include "RenderCache.hpp"
+
+#include <cstring>
+#include <iostream>
+
+/* samples per cached chunk; a job rendered again must be chunked the same way to hit */
+static constexpr int chunkSize = 1 << 15;
+static constexpr int blockSize = 512;
+
+static bool setParameters(STRXAudioProcessor &processor, const StringArray &settings)
+{
+    for (auto &arg : settings)
+    {
+        auto *param = processor.apvts.getParameter(arg.upToFirstOccurrenceOf("=", false, false));
+        if (param == nullptr)
+        {
+            std::cout << "unknown parameter " << arg << "\n";
+            return false;
+        }
+
+        param->setValueNotifyingHost(param->convertTo0to1(arg.fromFirstOccurrenceOf("=", false, false).getFloatValue()));
+    }
+
+    return true;
+}
+
+static void render(STRXAudioProcessor &processor, AudioBuffer<double> &buffer, int numSamples)
+{
+    const auto size = processor.getBlockSize();
+    MidiBuffer midi;
+    for (int b = 0; b < numSamples; b += size)
+    {
+        AudioBuffer<double> block(buffer.getArrayOfWritePointers(), buffer.getNumChannels(), b, jmin(size, numSamples - b));
+        processor.processBlock(block, midi);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    const ScopedJuceInitialiser_GUI juceInit;
+
+    if (argc < 3)
+    {
+        std::cout << "usage: strx_render <input> <output.wav> [id=value ...] [--no-cache] [--pipeline [--verify]]\n";
+        return 1;
+    }
+
+    const auto inputFile = File::getCurrentWorkingDirectory().getChildFile(argv[1]);
+    const auto outputFile = File::getCurrentWorkingDirectory().getChildFile(argv[2]);
+
+    AudioFormatManager formats;
+    formats.registerBasicFormats();
+    std::unique_ptr<AudioFormatReader> reader(formats.createReaderFor(inputFile));
+    if (reader == nullptr)
+    {
+        std::cout << "can't read " << inputFile.getFullPathName() << "\n";
+        return 1;
+    }
+
+    const auto numChannels = (int)jlimit(1u, 2u, reader->numChannels);
+    const auto sampleRate = reader->sampleRate;
+
+    bool useCache = true, pipelined = false, verify = false;
+    StringArray settings;
+    for (int i = 3; i < argc; ++i)
+    {
+        const String arg(argv[i]);
+        if (arg == "--no-cache")
+            useCache = false;
+        else if (arg == "--pipeline")
+            pipelined = true;
+        else if (arg == "--verify")
+            verify = true;
+        else
+            settings.add(arg);
+    }
+
+    if (verify && !pipelined)
+    {
+        std::cout << "--verify compares a pipelined render with a serial one, so needs --pipeline\n";
+        return 1;
+    }
+
+    /* the pipeline only runs on blocks longer than a piece, so it's fed whole chunks */
+    const auto processSize = pipelined ? chunkSize : blockSize;
+
+    STRXAudioProcessor processor;
+    processor.setNonRealtime(true);
+    processor.setPipelinedRendering(pipelined);
+    if (!setParameters(processor, settings))
+        return 1;
+
+    processor.setPlayConfigDetails(numChannels, numChannels, sampleRate, processSize);
+    processor.prepareToPlay(sampleRate, processSize);
+
+    std::unique_ptr<STRXAudioProcessor> serial;
+    if (verify)
+    {
+        useCache = false;
+        serial = std::make_unique<STRXAudioProcessor>();
+        serial->setNonRealtime(true);
+        setParameters(*serial, settings);
+        serial->setPlayConfigDetails(numChannels, numChannels, sampleRate, processSize);
+        serial->prepareToPlay(sampleRate, processSize);
+    }
+
+    outputFile.deleteFile();
+    std::unique_ptr<AudioFormatWriter> writer(WavAudioFormat().createWriterFor(new FileOutputStream(outputFile), sampleRate,
+                                                                              (unsigned int)numChannels, 32, {}, 0));
+    if (writer == nullptr)
+    {
+        std::cout << "can't write " << outputFile.getFullPathName() << "\n";
+        return 1;
+    }
+
+    std::unique_ptr<RenderCache> cache;
+    if (useCache)
+        cache = std::make_unique<RenderCache>();
+
+    AudioBuffer<float> io(numChannels, chunkSize);
+    AudioBuffer<double> chunk(numChannels, chunkSize), serialChunk;
+    if (serial != nullptr)
+        serialChunk.setSize(numChannels, chunkSize);
+    int64 firstMismatch = -1;
+
+    const auto start = Time::getHighResolutionTicks();
+
+    for (int64 pos = 0; pos < reader->lengthInSamples; pos += chunkSize)
+    {
+        const auto n = (int)jmin((int64)chunkSize, reader->lengthInSamples - pos);
+        reader->read(&io, 0, n, pos, true, numChannels > 1);
+
+        for (int ch = 0; ch < numChannels; ++ch)
+            for (int i = 0; i < n; ++i)
+                chunk.setSample(ch, i, (double)io.getSample(ch, i));
+
+        if (serial != nullptr)
+            for (int ch = 0; ch < numChannels; ++ch)
+                serialChunk.copyFrom(ch, 0, chunk, ch, 0, n);
+
+        if (cache != nullptr)
+            cache->process(processor, chunk, n);
+        else
+            render(processor, chunk, n);
+
+        if (serial != nullptr)
+        {
+            render(*serial, serialChunk, n);
+
+            for (int ch = 0; ch < numChannels && firstMismatch < 0; ++ch)
+                if (std::memcmp(chunk.getReadPointer(ch), serialChunk.getReadPointer(ch), (size_t)n * sizeof(double)) != 0)
+                    for (int i = 0; i < n; ++i)
+                        if (std::memcmp(chunk.getReadPointer(ch, i), serialChunk.getReadPointer(ch, i), sizeof(double)) != 0)
+                        {
+                            firstMismatch = pos + i;
+                            break;
+                        }
+        }
+
+        for (int ch = 0; ch < numChannels; ++ch)
+            for (int i = 0; i < n; ++i)
+                io.setSample(ch, i, (float)chunk.getSample(ch, i));
+
+        writer->writeFromAudioSampleBuffer(io, 0, n);
+    }
+
+    const auto elapsed = Time::highResolutionTicksToSeconds(Time::getHighResolutionTicks() - start);
+    const auto seconds = (double)reader->lengthInSamples / sampleRate;
+
+    std::cout << String(seconds, 2) << " s rendered in " << String(elapsed, 2) << " s (" << String(seconds / elapsed, 1) << "x realtime)\n";
+    if (cache != nullptr)
+    {
+        const auto stats = cache->getStats();
+        std::cout << "cache: " << (int64)stats.hits << " hits, " << (int64)stats.misses << " misses, " << (int64)stats.uncacheable
+                  << " uncacheable; " << stats.entries << " entries, " << String((double)stats.bytes / (1 << 20), 1) << " MB\n";
+    }
+
+    if (serial != nullptr)
+    {
+        if (firstMismatch >= 0)
+        {
+            std::cout << "pipelined render differs from serial, first at sample " << firstMismatch << "\n";
+            return 1;
+        }
+
+        std::cout << "pipelined render matches serial bit for bit\n";
+    }
+
+    return 0;
+}
@@ -0,0 +1,358 @@
+// Server.cpp
+// Long-running reamp service on a pool of warm engines:
+//   strx_server --stdio [--warm <rate> <channels> <count>]...
+//   strx_server --socket <path> [--warm <rate> <channels> <count>]...
+// One client on stdin/stdout, or any number on a Unix-domain socket (not on
+// Windows), each on its own thread. Log output goes to stderr.
+//
+// A connection carries requests back to back, all little-endian. A request
+// is a RequestHeader, `parametersSize` bytes of "id=value" lines with real
+// values, then `numFrames` interleaved float32 frames. The response is a
+// ResponseHeader, then the same number of processed frames, written block by
+// block as the input arrives. Engines come from the pool with the given
+// parameters over their defaults and a cleared state; with continueStream
+// set, the request keeps the connection's engine and state from the one
+// before and only applies its parameter changes, so a long stream can be
+// sent in pieces with automation between them.
+
+#include <JuceHeader.h>
+#include "EnginePool.hpp"
+
+#include <cstdio>
+#include <iostream>
+
+#if JUCE_LINUX || JUCE_MAC
+#include <cerrno>
+#include <csignal>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+struct RequestHeader
+{
+    uint32 magic;
+    uint32 flags;
+    double sampleRate;
+    uint32 numChannels, numFrames, parametersSize, reserved;
+};
+
+struct ResponseHeader
+{
+    uint32 magic;
+    uint32 status;
+    uint32 numChannels, numFrames;
+    /* of the engine, in frames; the output is not compensated */
+    uint32 latency;
+    uint32 errorSize;
+};
+
+static_assert(sizeof(RequestHeader) == 32 && sizeof(ResponseHeader) == 24, "wire headers are packed by layout");
+
+static constexpr uint32 requestMagic = 0x51585453;  // "STXQ"
+static constexpr uint32 responseMagic = 0x41585453; // "STXA"
+
+enum RequestFlags : uint32
+{
+    continueStream = 1
+};
+
+/* 0 ok; on an error the response carries errorSize bytes of message and no frames */
+enum Status : uint32
+{
+    ok = 0,
+    badRequest = 1,
+    badParameters = 2
+};
+
+static constexpr uint32 maxParametersSize = 1 << 16;
+
+/* a client's byte stream; reads and writes block until done, false once it's closed */
+class Connection
+{
+public:
+    virtual ~Connection() = default;
+    virtual bool read(void *data, size_t size) = 0;
+    virtual bool write(const void *data, size_t size) = 0;
+    virtual void flush() {}
+};
+
+class StdioConnection : public Connection
+{
+public:
+    bool read(void *data, size_t size) override { return std::fread(data, 1, size, stdin) == size; }
+    bool write(const void *data, size_t size) override { return std::fwrite(data, 1, size, stdout) == size; }
+    void flush() override { std::fflush(stdout); }
+};
+
+#if JUCE_LINUX || JUCE_MAC
+class SocketConnection : public Connection
+{
+public:
+    explicit SocketConnection(int fdToUse) : fd(fdToUse) {}
+    ~SocketConnection() override { ::close(fd); }
+
+    bool read(void *data, size_t size) override
+    {
+        for (auto *p = static_cast<char *>(data); size > 0;)
+        {
+            const auto n = ::read(fd, p, size);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                return false;
+            p += n;
+            size -= (size_t)n;
+        }
+        return true;
+    }
+
+    bool write(const void *data, size_t size) override
+    {
+        for (auto *p = static_cast<const char *>(data); size > 0;)
+        {
+            const auto n = ::write(fd, p, size);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                return false;
+            p += n;
+            size -= (size_t)n;
+        }
+        return true;
+    }
+
+private:
+    const int fd;
+};
+#endif
+
+static EnginePool::Parameters parseParameters(const String &text)
+{
+    EnginePool::Parameters parameters;
+    for (auto &line : StringArray::fromLines(text))
+    {
+        const auto entry = line.trim();
+        if (entry.isNotEmpty())
+            parameters.emplace_back(entry.upToFirstOccurrenceOf("=", false, false).trim(),
+                                    entry.fromFirstOccurrenceOf("=", false, false).getFloatValue());
+    }
+    return parameters;
+}
+
+static bool sendError(Connection &connection, Status status, const String &message)
+{
+    const ResponseHeader response{responseMagic, status, 0, 0, 0, (uint32)message.getNumBytesAsUTF8()};
+    const auto sent = connection.write(&response, sizeof(response)) && connection.write(message.toRawUTF8(), response.errorSize);
+    connection.flush();
+    return sent;
+}
+
+/* read and drop the frames of a request that was refused, so the next one can be read */
+static bool skipFrames(Connection &connection, const RequestHeader &request)
+{
+    std::vector<float> scratch(4096);
+    for (auto remaining = (size_t)request.numFrames * request.numChannels; remaining > 0;)
+    {
+        const auto n = jmin(remaining, scratch.size());
+        if (!connection.read(scratch.data(), n * sizeof(float)))
+            return false;
+        remaining -= n;
+    }
+    return true;
+}
+
+/* serve requests until the client closes the connection or breaks the protocol */
+static void serve(Connection &connection, EnginePool &pool)
+{
+    const auto blockSize = pool.getMaxBlockSize();
+    EnginePool::Engine engine;
+    std::vector<float> interleaved;
+    AudioBuffer<double> block;
+    MidiBuffer midi;
+
+    for (RequestHeader request; connection.read(&request, sizeof(request));)
+    {
+        if (request.magic != requestMagic || request.numChannels < 1 || request.numChannels > 2
+            || request.sampleRate < 8000.0 || request.sampleRate > 384000.0 || request.parametersSize > maxParametersSize)
+        {
+            sendError(connection, badRequest, "bad request header");
+            break;
+        }
+
+        MemoryBlock text(request.parametersSize);
+        if (!connection.read(text.getData(), text.getSize()))
+            break;
+
+        const auto parameters = parseParameters(text.toString());
+        const auto numChannels = (int)request.numChannels;
+
+        const auto continuing = (request.flags & continueStream) && engine != nullptr
+            && engine->getSampleRate() == request.sampleRate && engine->getTotalNumInputChannels() == numChannels;
+
+        String error;
+        if (continuing)
+        {
+            if (!EnginePool::setParameters(*engine, parameters, error))
+                pool.release(std::move(engine));
+        }
+        else
+        {
+            pool.release(std::move(engine));
+            engine = pool.acquire(request.sampleRate, numChannels, parameters, error);
+        }
+
+        if (engine == nullptr)
+        {
+            if (!sendError(connection, badParameters, error) || !skipFrames(connection, request))
+                break;
+            continue;
+        }
+
+        const ResponseHeader response{responseMagic, ok, request.numChannels, request.numFrames, (uint32)engine->getLatencySamples(), 0};
+        if (!connection.write(&response, sizeof(response)))
+            break;
+
+        interleaved.resize((size_t)blockSize * (size_t)numChannels);
+        block.setSize(numChannels, blockSize, false, false, true);
+
+        bool open = true;
+        for (uint32 done = 0; done < request.numFrames && open;)
+        {
+            const auto n = (int)jmin((uint32)blockSize, request.numFrames - done);
+            const auto bytes = (size_t)n * (size_t)numChannels * sizeof(float);
+
+            open = connection.read(interleaved.data(), bytes);
+            if (!open)
+                break;
+
+            for (int i = 0; i < n; ++i)
+                for (int ch = 0; ch < numChannels; ++ch)
+                    block.setSample(ch, i, (double)interleaved[(size_t)(i * numChannels + ch)]);
+
+            AudioBuffer<double> sub(block.getArrayOfWritePointers(), numChannels, n);
+            engine->processBlock(sub, midi);
+
+            for (int i = 0; i < n; ++i)
+                for (int ch = 0; ch < numChannels; ++ch)
+                    interleaved[(size_t)(i * numChannels + ch)] = (float)block.getSample(ch, i);
+
+            open = connection.write(interleaved.data(), bytes);
+            done += (uint32)n;
+        }
+
+        connection.flush();
+        if (!open)
+            break;
+    }
+
+    pool.release(std::move(engine));
+}
+
+#if JUCE_LINUX || JUCE_MAC
+static int listenOn(const String &path)
+{
+    sockaddr_un address{};
+    if (path.getNumBytesAsUTF8() >= sizeof(address.sun_path))
+        return -1;
+
+    address.sun_family = AF_UNIX;
+    std::memcpy(address.sun_path, path.toRawUTF8(), path.getNumBytesAsUTF8());
+
+    const auto fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+        return -1;
+
+    ::unlink(path.toRawUTF8());
+    if (bind(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 || listen(fd, 64) != 0)
+    {
+        ::close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+#endif
+
+int main(int argc, char *argv[])
+{
+    const ScopedJuceInitialiser_GUI juceInit;
+
+    EnginePool pool;
+    String socketPath;
+    bool stdio = false;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const String arg(argv[i]);
+        if (arg == "--stdio")
+            stdio = true;
+        else if (arg == "--socket" && i + 1 < argc)
+            socketPath = argv[++i];
+        else if (arg == "--warm" && i + 3 < argc)
+        {
+            const auto rate = String(argv[i + 1]).getDoubleValue();
+            const auto channels = jlimit(1, 2, String(argv[i + 2]).getIntValue());
+            const auto count = String(argv[i + 3]).getIntValue();
+            i += 3;
+
+            pool.warm(rate, channels, count);
+            std::cerr << "warmed " << count << " engines at " << rate << " Hz, " << channels << " ch\n";
+        }
+        else
+        {
+            std::cerr << "usage: strx_server (--stdio | --socket <path>) [--warm <rate> <channels> <count>]...\n";
+            return 1;
+        }
+    }
+
+    if (stdio == socketPath.isNotEmpty())
+    {
+        std::cerr << "pick one of --stdio and --socket\n";
+        return 1;
+    }
+
+    if (stdio)
+    {
+        StdioConnection connection;
+        serve(connection, pool);
+        return 0;
+    }
+
+#if JUCE_LINUX || JUCE_MAC
+    /* a client going away mid-response should fail the write, not end the server */
+    std::signal(SIGPIPE, SIG_IGN);
+
+    const auto listener = listenOn(socketPath);
+    if (listener < 0)
+    {
+        std::cerr << "can't listen on " << socketPath << "\n";
+        return 1;
+    }
+
+    std::cerr << "listening on " << socketPath << "\n";
+
+    for (;;)
+    {
+        const auto fd = accept(listener, nullptr, nullptr);
+        if (fd < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+
+        std::thread([fd, &pool]
+        {
+            SocketConnection connection(fd);
+            serve(connection, pool);
+        }).detach();
+    }
+
+    ::close(listener);
+    return 0;
+#else
+    std::cerr << "Unix-domain sockets aren't supported on this platform; use --stdio\n";
+    return 1;
+#endif
+}